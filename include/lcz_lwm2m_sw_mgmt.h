@@ -30,19 +30,164 @@ typedef enum lcz_lwm2m_sw_mgmt_event {
 	LCZ_LWM2M_SW_MGMT_EVENT_UNINSTALL,
 } lcz_lwm2m_sw_mgmt_event_t;
 
+/* Returned by an event callback, with CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS, to report the result
+ * later with lcz_lwm2m_sw_mgmt_event_complete(). The callback gets the sequence number to report
+ * with from lcz_lwm2m_sw_mgmt_event_seq().
+ */
+#define LCZ_LWM2M_SW_MGMT_EVENT_PENDING 1
+
+/* Returned by lcz_lwm2m_sw_mgmt_write_package() when the package was delivered from the package
+ * cache. The rest of the package is not needed.
+ */
+#define LCZ_LWM2M_SW_MGMT_WRITE_CACHED 1
+
+/* Resources of struct lcz_lwm2m_sw_mgmt_update to write */
+#define LCZ_LWM2M_SW_MGMT_UPDATE_PKG_NAME BIT(0)
+#define LCZ_LWM2M_SW_MGMT_UPDATE_PKG_VERSION BIT(1)
+#define LCZ_LWM2M_SW_MGMT_UPDATE_ACTIVATE BIT(2)
+
+typedef enum lcz_lwm2m_sw_mgmt_compression {
+	/* Packages are passed to the backend as received */
+	LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE = 0,
+	/* Packages are heatshrink compressed and decompressed before reaching the backend */
+	LCZ_LWM2M_SW_MGMT_COMPRESSION_HEATSHRINK,
+} lcz_lwm2m_sw_mgmt_compression_t;
+
+typedef enum lcz_lwm2m_sw_mgmt_failure {
+	/* A download block was rejected by the download pipeline or the backend */
+	LCZ_LWM2M_SW_MGMT_FAILURE_DOWNLOAD = 0,
+	/* The package did not match its expected digest */
+	LCZ_LWM2M_SW_MGMT_FAILURE_VERIFY,
+	/* The backend could not write the package to storage */
+	LCZ_LWM2M_SW_MGMT_FAILURE_STORAGE,
+	/* The install completed with an error */
+	LCZ_LWM2M_SW_MGMT_FAILURE_INSTALL,
+	/* The package manifest was rejected before any data reached the backend */
+	LCZ_LWM2M_SW_MGMT_FAILURE_REJECTED,
+	LCZ_LWM2M_SW_MGMT_FAILURE_COUNT
+} lcz_lwm2m_sw_mgmt_failure_t;
+
+/* Block handling time histogram. Bin n counts blocks handled in less than 128 << n microseconds,
+ * the last bin counts everything slower.
+ */
+#define LCZ_LWM2M_SW_MGMT_STATS_HIST_BINS 8
+
+struct lcz_lwm2m_sw_mgmt_stats {
+	/* Completed downloads and installs */
+	uint32_t downloads;
+	uint32_t installs;
+	/* Current (or last) download */
+	uint32_t bytes_received;
+	uint32_t blocks_received;
+	uint32_t download_time_ms;
+	/* Bytes per second of the last completed download */
+	uint32_t download_rate;
+	/* Time spent handling a block in write_data_cb, all downloads */
+	uint32_t block_time_max_us;
+	uint64_t block_time_total_us;
+	uint64_t blocks_total;
+	uint32_t block_time_hist[LCZ_LWM2M_SW_MGMT_STATS_HIST_BINS];
+	/* Storage writes reported by the backend, all downloads */
+	uint32_t storage_writes;
+	uint32_t storage_write_max_us;
+	uint64_t storage_write_total_us;
+	/* Current (or last) install, from install execute to completion */
+	uint32_t install_bytes;
+	uint32_t install_time_ms;
+	/* Bytes per second transferred by the backend during the install */
+	uint32_t install_rate;
+	uint32_t failures[LCZ_LWM2M_SW_MGMT_FAILURE_COUNT];
+};
+
 typedef int (*lcz_lwm2m_sw_mgmt_event_cb_t)(lcz_lwm2m_sw_mgmt_event_t event);
 typedef void *(*lcz_lwm2m_sw_mgmt_read_ver_cb_t)(void);
 typedef int (*lcz_lwm2m_sw_mgmt_download_data_cb_t)(uint8_t *data, uint16_t data_len,
 						    bool last_block, size_t total_size);
 
+/* Object 9 resources written together by lcz_lwm2m_sw_mgmt_update() */
+struct lcz_lwm2m_sw_mgmt_update {
+	/* LCZ_LWM2M_SW_MGMT_UPDATE_ flags of the fields below that are written */
+	uint32_t fields;
+	const char *pkg_name;
+	const char *pkg_version;
+	bool activate;
+};
+
+/* Part of the image passed to a download_data_v2_callback */
+struct lcz_lwm2m_sw_mgmt_chunk {
+	const uint8_t *data;
+	size_t len;
+};
+
+/**
+ * @brief Receive image data at an explicit offset
+ *
+ * The chunks are contiguous in the image, starting at offset. Several blocks may be delivered in
+ * one call, so the total length can exceed the size of a single block (and 64 KiB). Offset 0
+ * starts a new image. A retransmitted block repeats an offset that was already delivered and can
+ * be ignored by the backend.
+ *
+ * @param offset offset in the image of the first chunk
+ * @param chunks image data
+ * @param chunk_count number of chunks, at least 1
+ * @param last_block true if the last chunk ends the image
+ * @param total_size size of the image, 0 if unknown
+ * @return int 0 on success, < 0 on error
+ */
+typedef int (*lcz_lwm2m_sw_mgmt_download_data_v2_cb_t)(
+	size_t offset, const struct lcz_lwm2m_sw_mgmt_chunk *chunks, size_t chunk_count,
+	bool last_block, size_t total_size);
+
+/**
+ * @brief Read the currently installed image. Used as the source when a delta patch is applied.
+ *
+ * @param offset offset in the installed image
+ * @param data buffer to read into
+ * @param data_len number of bytes to read
+ * @return int 0 on success, < 0 on error
+ */
+typedef int (*lcz_lwm2m_sw_mgmt_source_read_cb_t)(size_t offset, uint8_t *data, size_t data_len);
+
 struct lcz_lwm2m_sw_mgmt_event_callback_agent {
 	sys_snode_t node;
 	uint16_t obj_inst;
 	lcz_lwm2m_sw_mgmt_event_cb_t event_callback;
 	lcz_lwm2m_sw_mgmt_read_ver_cb_t read_ver_callback;
 	lcz_lwm2m_sw_mgmt_download_data_cb_t download_data_callback;
+	/* Alternative to download_data_callback, used instead of it when set */
+	lcz_lwm2m_sw_mgmt_download_data_v2_cb_t download_data_v2_callback;
+	/* Optional. When set, delta patch packages are rebuilt into full images before they are
+	 * passed to download_data_callback. Without it, delta patches are rejected.
+	 */
+	lcz_lwm2m_sw_mgmt_source_read_cb_t source_read_callback;
+	/* Compression used by packages for this instance. Only used when creating the object. */
+	lcz_lwm2m_sw_mgmt_compression_t compression;
+	/* Optional. With CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST, packages whose manifest names a
+	 * different target are rejected. Only used when creating the object.
+	 */
+	const char *target;
+};
+
+/* Event subscriber declared at build time, used instead of
+ * lcz_lwm2m_sw_mgmt_register_event_callback() with CONFIG_LCZ_LWM2M_SW_MGMT_STATIC
+ */
+struct lcz_lwm2m_sw_mgmt_subscriber {
+	lcz_lwm2m_sw_mgmt_event_cb_t event_callback;
 };
 
+/**
+ * @brief Declare an event subscriber of the static instance
+ *
+ * Subscribers are called after the event callback of the agent that created the instance.
+ *
+ * @param _name name of the subscriber
+ * @param _cb event callback
+ */
+#define LCZ_LWM2M_SW_MGMT_SUBSCRIBER_DEFINE(_name, _cb)                                            \
+	static const STRUCT_SECTION_ITERABLE(lcz_lwm2m_sw_mgmt_subscriber, _name) = {              \
+		.event_callback = _cb,                                                             \
+	}
+
 /**************************************************************************************************/
 /* Global Function Prototypes                                                                     */
 /**************************************************************************************************/
@@ -52,8 +197,11 @@ struct lcz_lwm2m_sw_mgmt_event_callback_agent {
  *
  * @param obj_inst instance of object 9
  * @param agent agent to register required callbacks. All callbacks are required when creating the
- * object. read_ver_callback and download_data_callback callbacks only allow one registered user.
- * Those two callbacks will only be registered to the user who calls this function.
+ * object, except that only one of download_data_callback and download_data_v2_callback is needed.
+ * read_ver_callback and the download data callback only allow one registered user.
+ * Those callbacks will only be registered to the user who calls this function.
+ *
+ * @note obj_inst must be less than CONFIG_LCZ_LWM2M_SW_MGMT_MAX_INSTANCES.
  *
  * @return int 0 on success, < 0 on error
  */
@@ -67,7 +215,8 @@ int lcz_lwm2m_sw_mgmt_create_inst(uint16_t obj_inst,
  *
  * @param obj_inst instance of object 9
  * @param agent agent to register callbacks
- * @return int 0 on success, < 0 on error
+ * @return int 0 on success, -ENOTSUP with CONFIG_LCZ_LWM2M_SW_MGMT_STATIC (use
+ * LCZ_LWM2M_SW_MGMT_SUBSCRIBER_DEFINE), < 0 on error
  */
 int lcz_lwm2m_sw_mgmt_register_event_callback(uint16_t obj_inst,
 					      struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent);
@@ -77,10 +226,71 @@ int lcz_lwm2m_sw_mgmt_register_event_callback(uint16_t obj_inst,
  *
  * @param obj_inst instance of object 9
  * @param agent agent with registered callbacks
- * @return int 0 on success, < 0 on error
+ * @return int 0 on success, -ENOTSUP with CONFIG_LCZ_LWM2M_SW_MGMT_STATIC, < 0 on error
  */
-int lcz_lwm2m_sw_mgmt_register_event_callback(uint16_t obj_inst,
-					      struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent);
+int lcz_lwm2m_sw_mgmt_unregister_event_callback(
+	uint16_t obj_inst, struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent);
+
+/**
+ * @brief Set the digest the next downloaded package must match
+ *
+ * The digest is computed while the package is downloaded. If it does not match, the last block
+ * of the download fails and the following install is rejected.
+ * The expected digest is consumed by the next completed download.
+ *
+ * @param obj_inst instance of object 9
+ * @param digest expected CRC32 (little endian) or SHA-256, depending on the verification mode
+ * @param digest_len size of digest, 0 to clear the expected digest
+ * @return int 0 on success, -ENOTSUP if verification is disabled, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_set_expected_digest(uint16_t obj_inst, const uint8_t *digest,
+					  size_t digest_len);
+
+/**
+ * @brief Pass package data received outside of the LwM2M engine (e.g. a pull download) through
+ * the download pipeline of an instance, exactly like a block written to the Package resource.
+ *
+ * A block that repeats data already written is passed to a download_data_v2_callback at its
+ * offset in the image, so the backend can drop it. A repeat that reaches back to the start of
+ * the image isn't passed on, as image offset 0 starts a new image. Only the new part of the block
+ * goes through the pipeline.
+ *
+ * @param obj_inst instance of object 9
+ * @param offset offset of data in the package, 0 starts a new download
+ * @param data package data
+ * @param data_len size of data
+ * @param last_block true for the last block of the package
+ * @param total_size size of the package
+ * @return int 0 on success, LCZ_LWM2M_SW_MGMT_WRITE_CACHED if the transfer can stop, < 0 on
+ * error
+ */
+int lcz_lwm2m_sw_mgmt_write_package(uint16_t obj_inst, size_t offset, uint8_t *data,
+				    uint16_t data_len, bool last_block, size_t total_size);
+
+/**
+ * @brief Write several resources of an instance at once
+ *
+ * The LwM2M engine thread is held off until all of them are written, so an observer of the
+ * instance gets one notification with the new values instead of one per resource. This needs the
+ * registry lock of Zephyr 3.3 or later. Older versions can only write one resource per update.
+ * Resources are written in the order of the flags and writing stops at the first error.
+ *
+ * @param obj_inst instance of object 9
+ * @param update resources to write
+ * @return int 0 on success, -ENOTSUP if more than one resource is written before Zephyr 3.3,
+ * < 0 on other errors
+ */
+int lcz_lwm2m_sw_mgmt_update(uint16_t obj_inst, const struct lcz_lwm2m_sw_mgmt_update *update);
+
+/**
+ * @brief Tell the module the installed version reported by read_ver_callback has changed.
+ * The version is read again on the next read of the Package Version resource.
+ *
+ * @note The cached version is also dropped by lcz_lwm2m_sw_mgmt_install_completed().
+ *
+ * @param obj_inst instance of object 9
+ */
+void lcz_lwm2m_sw_mgmt_version_changed(uint16_t obj_inst);
 
 /**
  * @brief Set the software package name
@@ -109,6 +319,104 @@ int lcz_lwm2m_sw_mgmt_set_pkg_version(uint16_t obj_inst, char *value);
  */
 int lcz_lwm2m_sw_mgmt_set_activate_state(uint16_t obj_inst, bool activate);
 
+/**
+ * @brief Report the result of an install. Backends must use this instead of calling
+ * lwm2m_swmgmt_install_completed() directly so the module can track the install.
+ *
+ * @param obj_inst instance of object 9
+ * @param error_code 0 on success, < 0 if the install failed
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_install_completed(uint16_t obj_inst, int error_code);
+
+/**
+ * @brief Get the sequence number of the event being passed to the event callbacks. Call it from
+ * the callback that returns LCZ_LWM2M_SW_MGMT_EVENT_PENDING.
+ *
+ * @param obj_inst instance of object 9
+ * @return uint32_t sequence number, 0 if the event bus is disabled
+ */
+uint32_t lcz_lwm2m_sw_mgmt_event_seq(uint16_t obj_inst);
+
+/**
+ * @brief Report the result of an event the callback returned LCZ_LWM2M_SW_MGMT_EVENT_PENDING for
+ *
+ * Results reported after CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS_DEADLINE_MS are ignored, the event
+ * has already failed with -ETIMEDOUT.
+ *
+ * @param obj_inst instance of object 9
+ * @param seq sequence number of the event, from lcz_lwm2m_sw_mgmt_event_seq()
+ * @param result 0 on success, < 0 to veto the event
+ * @return int 0 on success, -ESTALE if the event already ended (deadline passed or result
+ * already reported), -ENOTSUP if the event bus is disabled, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_event_complete(uint16_t obj_inst, uint32_t seq, int result);
+
+/**
+ * @brief Get the performance statistics of an object instance
+ *
+ * @param obj_inst instance of object 9
+ * @param stats copy of the statistics
+ * @return int 0 on success, -ENOTSUP if statistics are disabled, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_get_stats(uint16_t obj_inst, struct lcz_lwm2m_sw_mgmt_stats *stats);
+
+/**
+ * @brief Clear the performance statistics of an object instance
+ *
+ * @param obj_inst instance of object 9
+ * @return int 0 on success, -ENOTSUP if statistics are disabled, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_reset_stats(uint16_t obj_inst);
+
+/**
+ * @brief Report a storage write performed by a backend while downloading
+ *
+ * @param obj_inst instance of object 9
+ * @param time_us time the write took
+ * @param result result of the write, < 0 counts as a storage failure
+ */
+void lcz_lwm2m_sw_mgmt_stats_storage_write(uint16_t obj_inst, uint32_t time_us, int result);
+
+/**
+ * @brief Report install progress of a backend (e.g. bytes transferred to a modem)
+ *
+ * @param obj_inst instance of object 9
+ * @param bytes bytes of the package installed so far
+ */
+void lcz_lwm2m_sw_mgmt_stats_install_progress(uint16_t obj_inst, size_t bytes);
+
+/**
+ * @brief Get an identifier of the package being downloaded, for a backend that resumes
+ * interrupted downloads.
+ *
+ * The identifier is a CRC of the expected digest (set by the application or a manifest) or,
+ * without one, of the Package URI resource.
+ *
+ * @param obj_inst instance of object 9
+ * @param id the identifier
+ * @return int 0 on success, -ENOENT if the package can't be identified, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_package_id(uint16_t obj_inst, uint32_t *id);
+
+/**
+ * @brief Claim the package resource of an instance for the pull downloader. Blocks pushed by the
+ * server are rejected until lcz_lwm2m_sw_mgmt_pull_end() is called.
+ *
+ * @param obj_inst instance of object 9
+ * @return int 0 on success, -EBUSY if a push or another pull is in progress, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_pull_begin(uint16_t obj_inst);
+
+/**
+ * @brief Release the package resource claimed by lcz_lwm2m_sw_mgmt_pull_begin() and set the
+ * Update State and Update Result resources from the result of the pull.
+ *
+ * @param obj_inst instance of object 9
+ * @param result 0 when the whole package was delivered, < 0 on error
+ */
+void lcz_lwm2m_sw_mgmt_pull_end(uint16_t obj_inst, int result);
+
 #ifdef __cplusplus
 }
 #endif
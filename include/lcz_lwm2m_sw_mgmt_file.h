@@ -0,0 +1,203 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_file.h
+ * @brief File staging backend for LwM2M software management.
+ *
+ * Stages downloaded packages in a file system so a backend can install them later.
+ * Each object instance gets its own staging state from a fixed pool, so several instances can
+ * download at the same time.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_FILE_H__
+#define __LCZ_LWM2M_SW_MGMT_FILE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+struct lcz_lwm2m_sw_mgmt_file;
+
+/* State of an A/B staging slot */
+enum lcz_lwm2m_sw_mgmt_file_slot_state {
+	LCZ_LWM2M_SW_MGMT_FILE_SLOT_EMPTY = 0,
+	LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADING,
+	/* Complete package that hasn't been installed */
+	LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED,
+	LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING,
+	/* Package that was installed successfully */
+	LCZ_LWM2M_SW_MGMT_FILE_SLOT_GOOD,
+};
+
+struct lcz_lwm2m_sw_mgmt_file_slot_info {
+	enum lcz_lwm2m_sw_mgmt_file_slot_state state;
+	size_t size;
+	/* The current (or next) download is written to this slot */
+	bool write;
+	/* The next install uses this slot */
+	bool install;
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Allocate staging state for an object instance
+ *
+ * A partial download left by a previous boot is kept if it can be resumed, otherwise any
+ * existing file is deleted.
+ *
+ * @param obj_inst instance of object 9
+ * @param file_name name of the staging file in CONFIG_FSU_MOUNT_POINT
+ * @return staging state, NULL if the pool is exhausted or the name is too long
+ */
+struct lcz_lwm2m_sw_mgmt_file *lcz_lwm2m_sw_mgmt_file_open(uint16_t obj_inst,
+							    const char *file_name);
+
+/**
+ * @brief Stage a block of a package. Call from the backend's download_data_callback.
+ *
+ * @param file staging state
+ * @param data package data
+ * @param data_len size of data
+ * @param last_block true for the last block of the package
+ * @param total_size size of the package
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_file_write(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t *data,
+				 uint16_t data_len, bool last_block, size_t total_size);
+
+/**
+ * @brief Write anything still buffered in RAM to the staging file
+ *
+ * With CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME the checkpoint is saved as well.
+ *
+ * @param file staging state
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_file_flush(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Delete the staging file and reset the download state
+ *
+ * @param file staging state
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_file_delete(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Make the next block start a new download
+ *
+ * The staged part of the current download is dropped by the next write. With
+ * CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME it is kept (and checkpointed) instead, and only resumed if
+ * the next download is the same package.
+ *
+ * @param file staging state
+ */
+void lcz_lwm2m_sw_mgmt_file_restart(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Get the number of bytes of the current download received so far
+ *
+ * @param file staging state
+ * @return size_t bytes received, 0 if the next block starts a new download
+ */
+size_t lcz_lwm2m_sw_mgmt_file_offset(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Check if a complete package is staged
+ *
+ * @param file staging state
+ * @return true if the last block of the package has been staged
+ */
+bool lcz_lwm2m_sw_mgmt_file_is_downloaded(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Get the size of the staged package
+ *
+ * @param file staging state
+ * @return size_t size of the complete package, 0 if no package is staged
+ */
+size_t lcz_lwm2m_sw_mgmt_file_size(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Get the absolute path of the staging file
+ *
+ * With CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB, this is the slot the next install uses.
+ *
+ * @param file staging state
+ * @return const char* absolute path
+ */
+const char *lcz_lwm2m_sw_mgmt_file_path(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Get the staging state of an object instance
+ *
+ * @param obj_inst instance of object 9
+ * @return staging state, NULL if the instance has none
+ */
+struct lcz_lwm2m_sw_mgmt_file *lcz_lwm2m_sw_mgmt_file_find(uint16_t obj_inst);
+
+/**
+ * @brief Mark the staged package as being installed. Downloads started before
+ * lcz_lwm2m_sw_mgmt_file_install_end() is called are written to the other slot.
+ *
+ * @param file staging state
+ * @return int 0 on success, -ENOENT if no package is staged, -ENOTSUP without A/B slots,
+ * other < 0 errors if the slot state could not be saved
+ */
+int lcz_lwm2m_sw_mgmt_file_install_begin(struct lcz_lwm2m_sw_mgmt_file *file);
+
+/**
+ * @brief Record the result of the install
+ *
+ * On success the slot becomes the last good image. On failure the package is kept so the install
+ * can be retried.
+ *
+ * @param file staging state
+ * @param result 0 on success, < 0 if the install failed
+ * @return int 0 on success, -EINVAL if no install is in progress, -ENOTSUP without A/B slots,
+ * other < 0 errors if the slot state could not be saved
+ */
+int lcz_lwm2m_sw_mgmt_file_install_end(struct lcz_lwm2m_sw_mgmt_file *file, int result);
+
+/**
+ * @brief Use the package in a slot for the next install, e.g. to reinstall or roll back to the
+ * last good image without downloading it again
+ *
+ * @param file staging state
+ * @param slot 0 (a) or 1 (b)
+ * @return int 0 on success, -ENOENT if the slot has no complete package, -EBUSY during an
+ * install, -ENOTSUP without A/B slots, other < 0 errors
+ */
+int lcz_lwm2m_sw_mgmt_file_select_slot(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot);
+
+/**
+ * @brief Get the state of a slot
+ *
+ * @param file staging state
+ * @param slot 0 (a) or 1 (b)
+ * @param info filled with the slot state
+ * @return int 0 on success, -ENOTSUP without A/B slots, other < 0 errors
+ */
+int lcz_lwm2m_sw_mgmt_file_slot_info(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot,
+				     struct lcz_lwm2m_sw_mgmt_file_slot_info *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_FILE_H__ */
@@ -0,0 +1,136 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_flash.h
+ * @brief Flash partition staging backend for LwM2M software management.
+ *
+ * Streams downloaded packages straight into a dedicated flash partition, bypassing the file
+ * system. Pages are erased just before they are first written, so no up-front erase of the
+ * whole partition is needed.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_FLASH_H__
+#define __LCZ_LWM2M_SW_MGMT_FLASH_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+struct lcz_lwm2m_sw_mgmt_flash;
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Allocate staging state for an object instance
+ *
+ * @param obj_inst instance of object 9
+ * @param area_id flash map ID of the staging partition, e.g. FLASH_AREA_ID(label)
+ * @return staging state, NULL if the pool is exhausted or the partition can't be opened
+ */
+struct lcz_lwm2m_sw_mgmt_flash *lcz_lwm2m_sw_mgmt_flash_open(uint16_t obj_inst, uint8_t area_id);
+
+/**
+ * @brief Stage a block of a package. Call from the backend's download_data_callback.
+ *
+ * @param flash staging state
+ * @param data package data
+ * @param data_len size of data
+ * @param last_block true for the last block of the package
+ * @param total_size size of the package
+ * @return int 0 on success, -EFBIG if the package doesn't fit in the partition, other < 0 errors
+ * from the flash driver
+ */
+int lcz_lwm2m_sw_mgmt_flash_write(struct lcz_lwm2m_sw_mgmt_flash *flash, uint8_t *data,
+				  uint16_t data_len, bool last_block, size_t total_size);
+
+/**
+ * @brief Write anything still buffered in RAM to flash
+ *
+ * @param flash staging state
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_flash_flush(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Forget the staged package. The partition is not erased, the next download erases
+ * pages as it reaches them.
+ *
+ * @param flash staging state
+ */
+void lcz_lwm2m_sw_mgmt_flash_discard(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Make the next block start a new download, the staged part of the current download is
+ * dropped
+ *
+ * @param flash staging state
+ */
+void lcz_lwm2m_sw_mgmt_flash_restart(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Get the number of bytes of the current download received so far
+ *
+ * @param flash staging state
+ * @return size_t bytes received, 0 if the next block starts a new download
+ */
+size_t lcz_lwm2m_sw_mgmt_flash_offset(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Check if a complete package is staged
+ *
+ * @param flash staging state
+ * @return true if the last block of the package has been written
+ */
+bool lcz_lwm2m_sw_mgmt_flash_is_downloaded(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Get the size of the staged package
+ *
+ * @param flash staging state
+ * @return size_t size of the complete package, 0 if no package is staged
+ */
+size_t lcz_lwm2m_sw_mgmt_flash_size(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Get the path of the staged package in the read-only file view of the staging partitions
+ *
+ * Lets code that only reads packages from files (e.g. a modem driver) read the partition
+ * directly, without copying the package to a real file system first.
+ *
+ * @param flash staging state
+ * @return const char* path, NULL if no package is staged or CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS is
+ * disabled
+ */
+const char *lcz_lwm2m_sw_mgmt_flash_path(struct lcz_lwm2m_sw_mgmt_flash *flash);
+
+/**
+ * @brief Read back staged data
+ *
+ * @param flash staging state
+ * @param offset offset in the package
+ * @param data destination
+ * @param data_len number of bytes to read
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_flash_read(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t offset,
+				 uint8_t *data, size_t data_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_FLASH_H__ */
@@ -0,0 +1,69 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_pull.h
+ * @brief Windowed CoAP pull downloader for LwM2M software management.
+ *
+ * Fetches a package from a coap:// URI with Block2 requests, keeping several requests in flight,
+ * and feeds the blocks in order through the same download pipeline as packages pushed to the
+ * Package resource.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_PULL_H__
+#define __LCZ_LWM2M_SW_MGMT_PULL_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/**
+ * @brief Called from the pull thread when a pull download ends
+ *
+ * @param obj_inst instance of object 9
+ * @param result 0 when the whole package was delivered, < 0 on error or cancellation
+ */
+typedef void (*lcz_lwm2m_sw_mgmt_pull_result_cb_t)(uint16_t obj_inst, int result);
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Start downloading a package
+ *
+ * The server must report the package size with the Size2 option.
+ *
+ * @param obj_inst instance of object 9 that receives the package
+ * @param uri coap://host[:port]/path[?query] of the package
+ * @param result_cb optional, called when the download ends
+ * @return int 0 if the download was started, -EBUSY if a pull is already running or the server
+ * is pushing a package to the instance, -EINVAL if the URI is too long or malformed or the
+ * instance doesn't exist, -EPROTONOSUPPORT if the scheme is not coap
+ */
+int lcz_lwm2m_sw_mgmt_pull_start(uint16_t obj_inst, const char *uri,
+				 lcz_lwm2m_sw_mgmt_pull_result_cb_t result_cb);
+
+/**
+ * @brief Stop the running pull download. The result callback reports -ECANCELED.
+ *
+ * @return int 0 on success, -EALREADY if no pull is running
+ */
+int lcz_lwm2m_sw_mgmt_pull_cancel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_PULL_H__ */
@@ -0,0 +1,90 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_sched.h
+ * @brief Install scheduler for LwM2M software management.
+ *
+ * Backends hand their installs to the scheduler instead of starting them from the install event.
+ * Installs of all object 9 instances run one at a time, in dependency and priority order. Installs
+ * that interrupt the modem or network connection run after the others and back to back, so an
+ * update campaign causes a single outage.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_SCHED_H__
+#define __LCZ_LWM2M_SW_MGMT_SCHED_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* The install resets the modem or drops the network connection */
+#define LCZ_LWM2M_SW_MGMT_INSTALL_RESET BIT(0)
+
+/**
+ * @brief Start an install. Called from the system work queue.
+ *
+ * The backend must report the result with lcz_lwm2m_sw_mgmt_install_completed(), also when the
+ * install could not be started. The next install starts after that.
+ *
+ * @param obj_inst instance of object 9
+ */
+typedef void (*lcz_lwm2m_sw_mgmt_install_start_cb_t)(uint16_t obj_inst);
+
+struct lcz_lwm2m_sw_mgmt_install_desc {
+	lcz_lwm2m_sw_mgmt_install_start_cb_t start;
+	/* LCZ_LWM2M_SW_MGMT_INSTALL_ flags */
+	uint32_t flags;
+	/* Lower values are installed first */
+	uint8_t priority;
+	/* Instance whose pending install must complete first, < 0 for none. If that install fails,
+	 * this one fails with -ECANCELED.
+	 */
+	int after;
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Queue the install of a downloaded package
+ *
+ * Installs without LCZ_LWM2M_SW_MGMT_INSTALL_RESET can start right away. Installs with it wait
+ * CONFIG_LCZ_LWM2M_SW_MGMT_SCHED_SETTLE_MS, so the response to the install execute reaches the
+ * server and installs requested in the meantime join the same outage.
+ *
+ * @param obj_inst instance of object 9
+ * @param desc how to start the install, copied
+ * @return int 0 on success, -EALREADY if an install of obj_inst is queued or running, -EINVAL on
+ * invalid parameters
+ */
+int lcz_lwm2m_sw_mgmt_schedule_install(uint16_t obj_inst,
+				       const struct lcz_lwm2m_sw_mgmt_install_desc *desc);
+
+/**
+ * @brief Tell the scheduler an install completed
+ *
+ * @note Called by lcz_lwm2m_sw_mgmt_install_completed(), backends don't call this.
+ *
+ * @param obj_inst instance of object 9
+ * @param result result of the install
+ */
+void lcz_lwm2m_sw_mgmt_sched_completed(uint16_t obj_inst, int result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_SCHED_H__ */
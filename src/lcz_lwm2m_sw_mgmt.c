@@ -14,22 +14,287 @@ LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL)
 
 #include <zephyr/zephyr.h>
 #include <zephyr/init.h>
+#include <version.h>
 #include <zephyr/net/lwm2m.h>
 #include <lwm2m_engine.h>
+#include <zephyr/sys/crc.h>
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_SHA256)
+#include <mbedtls/sha256.h>
+#endif
 
 #include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+#include "lcz_lwm2m_sw_mgmt_delta.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+#include "lcz_lwm2m_sw_mgmt_decompress.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+#include "lcz_lwm2m_sw_mgmt_manifest.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+#include "lcz_lwm2m_sw_mgmt_cache.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+#include "lcz_lwm2m_sw_mgmt_sched.h"
+#endif
+#include "lcz_lwm2m_sw_mgmt_trace.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_INSTANCES CONFIG_LCZ_LWM2M_SW_MGMT_MAX_INSTANCES
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+#define STATIC_OBJ_INST CONFIG_LCZ_LWM2M_SW_MGMT_STATIC_OBJ_INST
+
+BUILD_ASSERT(STATIC_OBJ_INST < MAX_INSTANCES, "Static instance out of range");
+
+/* One table entry, for the instance fixed at build time */
+#define INST_COUNT 1
+#define INST_VALID(obj_inst) ((obj_inst) == STATIC_OBJ_INST)
+#define INST_INDEX(obj_inst) 0
+#define INST_ID(inst) STATIC_OBJ_INST
+
+/* Resource paths are string constants, res must be a string literal */
+#define RES_PATH_DEFINE(name, obj_inst, res)                                                       \
+	static const char name[] = "9/" STRINGIFY(STATIC_OBJ_INST) "/" res;                      \
+	ARG_UNUSED(obj_inst)
+#else
+#define INST_COUNT MAX_INSTANCES
+#define INST_VALID(obj_inst) ((obj_inst) < MAX_INSTANCES)
+#define INST_INDEX(obj_inst) (obj_inst)
+#define INST_ID(inst) ((uint16_t)((inst) - sw_mgmt_inst))
+
+#define RES_PATH_DEFINE(name, obj_inst, res)                                                       \
+	char name[LWM2M_MAX_PATH_STR_LEN];                                                         \
+	snprintk(name, sizeof(name), "9/%d/" res, obj_inst)
+#endif
+
+/* The registry lock was added to the LwM2M engine in Zephyr 3.3. Older engines notify observers
+ * once per resource written, so they can only update one resource at a time.
+ */
+#if ZEPHYR_VERSION_CODE >= ZEPHYR_VERSION(3, 3, 0)
+#define REGISTRY_LOCKABLE 1
+#define REGISTRY_LOCK() lwm2m_registry_lock()
+#define REGISTRY_UNLOCK() lwm2m_registry_unlock()
+#else
+#define REGISTRY_LOCKABLE 0
+#define REGISTRY_LOCK()
+#define REGISTRY_UNLOCK()
+#endif
+
+/* Package resource of object 9 */
+#define PACKAGE_RES_ID 2
+/* Length of the Package URI resource in the engine */
+#define PACKAGE_URI_MAX_LEN 255
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+/* A push that sent no block for the CoAP EXCHANGE_LIFETIME is considered abandoned */
+#define PUSH_IDLE_MS (247 * MSEC_PER_SEC)
+
+/* Update State and Update Result values of object 9 */
+#define UPDATE_STATE_INITIAL 0
+#define UPDATE_STATE_DOWNLOAD_STARTED 1
+#define UPDATE_STATE_DELIVERED 3
+#define UPDATE_RESULT_INITIAL 0
+#define UPDATE_RESULT_DOWNLOADING 1
+#define UPDATE_RESULT_DOWNLOADED 3
+#define UPDATE_RESULT_NO_STORAGE 50
+#define UPDATE_RESULT_OUT_OF_MEMORY 51
+#define UPDATE_RESULT_CONNECTION_LOST 52
+#define UPDATE_RESULT_INTEGRITY_FAILURE 53
+#define UPDATE_RESULT_DEVICE_ERROR 57
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+#define ASYNC_BLOCK_SIZE CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_BLOCK_SIZE
+#define ASYNC_BLOCK_COUNT CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_BLOCK_COUNT
+#define ASYNC_TIMEOUT K_MSEC(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_TIMEOUT_MS)
+#define ASYNC_BATCH_COUNT CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_BATCH_COUNT
+
+BUILD_ASSERT(ASYNC_BATCH_COUNT <= ASYNC_BLOCK_COUNT, "Batch larger than the download queue");
+
+struct download_block {
+	uint16_t obj_inst;
+	uint16_t data_len;
+	bool last_block;
+	/* Download of the instance the block belongs to */
+	uint32_t download_id;
+	/* Offset of data in the image passed to the backend */
+	size_t offset;
+	size_t total_size;
+	uint8_t data[ASYNC_BLOCK_SIZE];
+};
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+#define EVENT_BUS_DEADLINE_MS CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS_DEADLINE_MS
+
+struct event_msg {
+	uint16_t obj_inst;
+	lcz_lwm2m_sw_mgmt_event_t event;
+	/* Activation state when the execute was received, restored if the event fails */
+	bool was_active;
+};
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_CRC32)
+#define DIGEST_SIZE sizeof(uint32_t)
+#elif defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_SHA256)
+#define DIGEST_SIZE 32
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+/* Running digest of the package, updated as each block is received */
+struct sw_mgmt_verify {
+	size_t offset;
+	bool expected_set;
+	uint8_t expected[DIGEST_SIZE];
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_CRC32)
+	uint32_t crc;
+#else
+	mbedtls_sha256_context sha;
+#endif
+};
+#endif
+
+/* Per object instance dispatch entry.
+ * The single-owner callbacks are set once by lcz_lwm2m_sw_mgmt_create_inst (before the engine
+ * callbacks are installed) and never change afterwards, so they are read without a lock.
+ * Only the event subscriber list (and the expected digest) is protected by cb_lock.
+ * With CONFIG_LCZ_LWM2M_SW_MGMT_STATIC, the subscribers are fixed at build time and dispatching
+ * takes no lock.
+ */
+struct sw_mgmt_inst {
+	lcz_lwm2m_sw_mgmt_read_ver_cb_t read_ver_callback;
+	lcz_lwm2m_sw_mgmt_download_data_cb_t download_data_callback;
+	lcz_lwm2m_sw_mgmt_download_data_v2_cb_t download_data_v2_callback;
+	lcz_lwm2m_sw_mgmt_source_read_cb_t source_read_callback;
+	lcz_lwm2m_sw_mgmt_compression_t compression;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+	/* Event callback of the creator, the other subscribers are in an iterable section */
+	lcz_lwm2m_sw_mgmt_event_cb_t event_callback;
+#else
+	sys_slist_t event_callback_list;
+#endif
+	/* Bytes of the current package received from the server */
+	size_t rx_offset;
+	/* Bytes of the current image passed to the backend (after decompression and patching) */
+	size_t tx_offset;
+	/* Offset in the image of the block being handled, from its position in the package. Only
+	 * used while the image isn't decompressed, patched or served from the cache.
+	 */
+	size_t image_offset;
+	/* Set when a new package starts, cleared once its first data reaches the patch stage */
+	bool patch_start;
+	/* Set when a new package starts, cleared once the first data after the manifest is
+	 * handled
+	 */
+	bool payload_start;
+	/* First error seen for the current download, checked before an install is allowed */
+	atomic_t download_err;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+	/* The pull downloader owns the package of this instance */
+	atomic_t pulling;
+	/* The server is pushing a package, since push_time (uptime ms) */
+	atomic_t pushing;
+	uint32_t push_time;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	/* Given by the writer when the last queued block of this instance has been handled */
+	struct k_sem download_done;
+	/* Incremented when a download starts, the writer drops blocks queued for an earlier one */
+	atomic_t download_id;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	/* Sequence number of the event in progress, completions for other events are stale */
+	uint32_t event_seq;
+	/* Subscribers still working on the event in progress */
+	int event_pending;
+	/* First error reported for the event in progress */
+	int event_err;
+	/* Given each time a pending subscriber completes */
+	struct k_sem event_done;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	struct sw_mgmt_verify verify;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+	const char *target;
+	struct lcz_lwm2m_sw_mgmt_manifest manifest;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	/* Cache entry holding the package being received, < 0 if it isn't cached */
+	int cache_entry;
+	/* Set once the cached image has been passed to the backend */
+	bool cache_served;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERSION_CACHE)
+	/* Cleared when the version changes, only the engine thread fills the copy */
+	atomic_t ver_valid;
+	uint8_t ver_len;
+	char ver[CONFIG_LCZ_LWM2M_SW_MGMT_VERSION_CACHE_SIZE];
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	struct lcz_lwm2m_sw_mgmt_stats stats;
+	int64_t download_start;
+	int64_t install_start;
+#endif
+};
 
 /**************************************************************************************************/
 /* Local Data Definitions                                                                         */
 /**************************************************************************************************/
-static sys_slist_t sw_mgmt_event_callback_list =
-	SYS_SLIST_STATIC_INIT(&sw_mgmt_event_callback_list);
+static struct sw_mgmt_inst sw_mgmt_inst[INST_COUNT];
 
 static K_MUTEX_DEFINE(cb_lock);
 
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+/* Statistics are updated from the engine, writer and backend threads */
+static struct k_spinlock stats_lock;
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+/* Protects the event sequence, pending count and error of every instance */
+static struct k_spinlock event_lock;
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+K_MEM_SLAB_DEFINE_STATIC(download_slab, sizeof(struct download_block), ASYNC_BLOCK_COUNT, 4);
+K_MSGQ_DEFINE(download_msgq, sizeof(struct download_block *), ASYNC_BLOCK_COUNT, 4);
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+K_MSGQ_DEFINE(event_msgq, sizeof(struct event_msg), CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS_QUEUE_SIZE,
+	      4);
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+/* One patch can be applied at a time, which bounds the RAM used by the decoder */
+static struct lcz_lwm2m_sw_mgmt_delta delta;
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+/* Shared by all instances for the same reason: the window is the largest buffer */
+static struct lcz_lwm2m_sw_mgmt_decompress decompress;
+#endif
+
 /**************************************************************************************************/
 /* Local Function Prototypes                                                                      */
 /**************************************************************************************************/
+static struct sw_mgmt_inst *get_inst(uint16_t obj_inst);
+static int dispatch_one(struct sw_mgmt_inst *inst, lcz_lwm2m_sw_mgmt_event_cb_t cb,
+			lcz_lwm2m_sw_mgmt_event_t event);
+static int dispatch_event(uint16_t obj_inst_id, lcz_lwm2m_sw_mgmt_event_t event);
+static int post_event(uint16_t obj_inst_id, lcz_lwm2m_sw_mgmt_event_t event);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+static int event_complete(struct sw_mgmt_inst *inst, uint32_t seq, int result);
+static int event_wait(struct sw_mgmt_inst *inst);
+static void event_result(struct event_msg *msg, int result);
+static void event_bus_thread(void *arg1, void *arg2, void *arg3);
+#endif
 static int sw_mgmt_activate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len);
 static int sw_mgmt_deactivate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len);
 static int sw_mgmt_install_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len);
@@ -38,266 +303,1690 @@ static void *read_ver_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_ins
 			 size_t *data_len);
 static int write_data_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id, uint8_t *data,
 			 uint16_t data_len, bool last_block, size_t total_size);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+static int push_write_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			 uint8_t *data, uint16_t data_len, bool last_block, size_t total_size);
+static int set_update_state(uint16_t obj_inst, uint8_t state, uint8_t result);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+static void verify_update(struct sw_mgmt_inst *inst, bool new_download, uint8_t *data,
+			  uint16_t data_len);
+static int verify_finish(struct sw_mgmt_inst *inst);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+static int manifest_check(struct sw_mgmt_inst *inst, size_t total_size);
+static int manifest_strip(struct sw_mgmt_inst *inst, bool new_download, uint8_t **data,
+			  size_t *data_len, bool last_block, size_t *total_size);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+static int cache_serve(uint16_t obj_inst_id, bool last_block);
+#endif
+static bool inst_created(struct sw_mgmt_inst *inst);
+static int backend_write(struct sw_mgmt_inst *inst, size_t offset,
+			 const struct lcz_lwm2m_sw_mgmt_chunk *chunks, size_t chunk_count,
+			 bool last_block, size_t total_size);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+static int queue_download_data(uint16_t obj_inst_id, size_t offset, uint8_t *data,
+			       uint16_t data_len, bool last_block, size_t total_size);
+static void download_writer_thread(void *arg1, void *arg2, void *arg3);
+#endif
+static int deliver_download_data(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len,
+				 bool last_block, size_t total_size);
+static bool image_transformed(struct sw_mgmt_inst *inst);
+static size_t package_header_size(struct sw_mgmt_inst *inst);
+static int deliver_duplicate(struct sw_mgmt_inst *inst, size_t offset, uint8_t *data,
+			     uint16_t data_len, size_t total_size);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+static int delta_begin(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len);
+#endif
+static int patch_download_data(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len,
+			       bool last_block, size_t total_size);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+static void stats_block(struct sw_mgmt_inst *inst, bool new_download, uint16_t data_len,
+			bool last_block, uint32_t start_cycles, int result);
+static void stats_failure(struct sw_mgmt_inst *inst, lcz_lwm2m_sw_mgmt_failure_t failure);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+static int decompress_begin(uint16_t obj_inst_id);
+#endif
 
 /**************************************************************************************************/
 /* Local Function Definitions                                                                     */
 /**************************************************************************************************/
-static int sw_mgmt_activate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+static struct sw_mgmt_inst *get_inst(uint16_t obj_inst)
 {
-	int ret;
-	sys_snode_t *node;
-	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
+	return &sw_mgmt_inst[INST_INDEX(obj_inst)];
+}
 
-	ARG_UNUSED(args);
-	ARG_UNUSED(args_len);
-	ret = 0;
+/* Returns the result to merge into the dispatch result, 0 while the subscriber is pending */
+static int dispatch_one(struct sw_mgmt_inst *inst, lcz_lwm2m_sw_mgmt_event_cb_t cb,
+			lcz_lwm2m_sw_mgmt_event_t event)
+{
+	int ret;
 
-	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE(&sw_mgmt_event_callback_list, node) {
-		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			ret |= agent->event_callback(LCZ_LWM2M_SW_MGMT_EVENT_ACTIVATE);
-		}
+	if (cb == NULL) {
+		return 0;
 	}
-	k_mutex_unlock(&cb_lock);
 
+	ret = cb(event);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	if (ret == LCZ_LWM2M_SW_MGMT_EVENT_PENDING) {
+		k_spinlock_key_t key = k_spin_lock(&event_lock);
+
+		inst->event_pending++;
+		k_spin_unlock(&event_lock, key);
+		return 0;
+	}
+#else
+	ARG_UNUSED(inst);
+#endif
 	return ret;
 }
 
-static int sw_mgmt_deactivate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+static int dispatch_event(uint16_t obj_inst_id, lcz_lwm2m_sw_mgmt_event_t event)
+{
+	int ret;
+	struct sw_mgmt_inst *inst;
+
+	if (!INST_VALID(obj_inst_id)) {
+		return -ENOENT;
+	}
+	inst = get_inst(obj_inst_id);
+
+	ret = dispatch_one(inst, inst->event_callback, event);
+	STRUCT_SECTION_FOREACH(lcz_lwm2m_sw_mgmt_subscriber, sub) {
+		ret |= dispatch_one(inst, sub->event_callback, event);
+	}
+
+	return ret;
+}
+#else
+static int dispatch_event(uint16_t obj_inst_id, lcz_lwm2m_sw_mgmt_event_t event)
 {
 	int ret;
 	sys_snode_t *node;
+	struct sw_mgmt_inst *inst;
 	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
 
-	ARG_UNUSED(args);
-	ARG_UNUSED(args_len);
-	ret = 0;
+	if (!INST_VALID(obj_inst_id)) {
+		return -ENOENT;
+	}
+	inst = get_inst(obj_inst_id);
 
+	ret = 0;
 	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE(&sw_mgmt_event_callback_list, node) {
+	SYS_SLIST_FOR_EACH_NODE(&inst->event_callback_list, node) {
 		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			ret |= agent->event_callback(LCZ_LWM2M_SW_MGMT_EVENT_DEACTIVATE);
-		}
+		ret |= dispatch_one(inst, agent->event_callback, event);
 	}
 	k_mutex_unlock(&cb_lock);
 
 	return ret;
 }
+#endif
 
-static int sw_mgmt_install_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+/* Completions of an earlier event, e.g. after its deadline, must not count for the current one */
+static int event_complete(struct sw_mgmt_inst *inst, uint32_t seq, int result)
+{
+	k_spinlock_key_t key = k_spin_lock(&event_lock);
+
+	if (seq != inst->event_seq || inst->event_pending <= 0) {
+		k_spin_unlock(&event_lock, key);
+		return -ESTALE;
+	}
+
+	inst->event_pending--;
+	if (result < 0 && inst->event_err == 0) {
+		inst->event_err = result;
+	}
+	k_spin_unlock(&event_lock, key);
+
+	k_sem_give(&inst->event_done);
+	return 0;
+}
+
+static int event_wait(struct sw_mgmt_inst *inst)
 {
+	int64_t deadline = k_uptime_get() + EVENT_BUS_DEADLINE_MS;
+	int64_t remaining;
+	k_spinlock_key_t key;
 	int ret;
-	sys_snode_t *node;
-	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
 
+	while (true) {
+		key = k_spin_lock(&event_lock);
+		if (inst->event_pending <= 0) {
+			ret = inst->event_err;
+			break;
+		}
+		remaining = deadline - k_uptime_get();
+		if (remaining <= 0) {
+			inst->event_pending = 0;
+			ret = -ETIMEDOUT;
+			break;
+		}
+		k_spin_unlock(&event_lock, key);
+		(void)k_sem_take(&inst->event_done, K_MSEC(remaining));
+	}
+	k_spin_unlock(&event_lock, key);
+	return ret;
+}
+
+/* Drive the object to the state matching the aggregated result */
+static void event_result(struct event_msg *msg, int result)
+{
+	if (result >= 0) {
+		return;
+	}
+
+	LOG_ERR("Event %d for instance %d failed [%d]", msg->event, msg->obj_inst, result);
+	switch (msg->event) {
+	case LCZ_LWM2M_SW_MGMT_EVENT_INSTALL:
+		(void)lcz_lwm2m_sw_mgmt_install_completed(msg->obj_inst, result);
+		break;
+	case LCZ_LWM2M_SW_MGMT_EVENT_ACTIVATE:
+	case LCZ_LWM2M_SW_MGMT_EVENT_DEACTIVATE:
+		(void)lcz_lwm2m_sw_mgmt_set_activate_state(msg->obj_inst, msg->was_active);
+		break;
+	default:
+		/* The engine has already reset the object, there is nothing to undo */
+		break;
+	}
+}
+
+static void event_bus_thread(void *arg1, void *arg2, void *arg3)
+{
+	int ret;
+	struct event_msg msg;
+	struct sw_mgmt_inst *inst;
+	k_spinlock_key_t key;
+	uint32_t seq;
+
+	ARG_UNUSED(arg1);
+	ARG_UNUSED(arg2);
+	ARG_UNUSED(arg3);
+
+	while (true) {
+		(void)k_msgq_get(&event_msgq, &msg, K_FOREVER);
+		inst = get_inst(msg.obj_inst);
+
+		/* The extra count covers subscribers that complete before dispatch returns */
+		k_sem_reset(&inst->event_done);
+		key = k_spin_lock(&event_lock);
+		seq = ++inst->event_seq;
+		inst->event_err = 0;
+		inst->event_pending = 1;
+		k_spin_unlock(&event_lock, key);
+
+		ret = dispatch_event(msg.obj_inst, msg.event);
+		(void)event_complete(inst, seq, ret);
+		event_result(&msg, event_wait(inst));
+	}
+}
+
+K_THREAD_DEFINE(event_bus, CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS_STACK_SIZE, event_bus_thread, NULL,
+		NULL, NULL, CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS_THREAD_PRIORITY, 0, 0);
+#endif
+
+/* Hand an execute to the subscribers, on the engine thread or through the event bus */
+static int post_event(uint16_t obj_inst_id, lcz_lwm2m_sw_mgmt_event_t event)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	int ret;
+	struct event_msg msg;
+
+	if (!INST_VALID(obj_inst_id)) {
+		return -ENOENT;
+	}
+
+	RES_PATH_DEFINE(obj_path, obj_inst_id, "12");
+	msg.obj_inst = obj_inst_id;
+	msg.event = event;
+	msg.was_active = false;
+	(void)lwm2m_engine_get_bool(obj_path, &msg.was_active);
+
+	/* Never block the engine thread */
+	ret = k_msgq_put(&event_msgq, &msg, K_NO_WAIT);
+	if (ret < 0) {
+		LOG_ERR("Event queue full [%d]", ret);
+		return -EBUSY;
+	}
+	return 0;
+#else
+	return dispatch_event(obj_inst_id, event);
+#endif
+}
+
+static int sw_mgmt_activate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
 	ARG_UNUSED(args);
 	ARG_UNUSED(args_len);
-	ret = 0;
 
-	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE(&sw_mgmt_event_callback_list, node) {
-		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			ret |= agent->event_callback(LCZ_LWM2M_SW_MGMT_EVENT_INSTALL);
-		}
-	}
-	k_mutex_unlock(&cb_lock);
+	return post_event(obj_inst_id, LCZ_LWM2M_SW_MGMT_EVENT_ACTIVATE);
+}
 
-	return ret;
+static int sw_mgmt_deactivate_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	ARG_UNUSED(args);
+	ARG_UNUSED(args_len);
+
+	return post_event(obj_inst_id, LCZ_LWM2M_SW_MGMT_EVENT_DEACTIVATE);
 }
 
-static int sw_mgmt_uninstall_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+static int sw_mgmt_install_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
 {
 	int ret;
-	sys_snode_t *node;
-	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
 
 	ARG_UNUSED(args);
 	ARG_UNUSED(args_len);
-	ret = 0;
 
-	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE(&sw_mgmt_event_callback_list, node) {
-		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			ret |= agent->event_callback(LCZ_LWM2M_SW_MGMT_EVENT_UNINSTALL);
+	SW_MGMT_TRACE_INSTALL(obj_inst_id);
+
+	/* A write or verification that failed after the last block was received fails the
+	 * install before any backend starts working on the package.
+	 */
+	if (INST_VALID(obj_inst_id)) {
+		ret = atomic_get(&get_inst(obj_inst_id)->download_err);
+		if (ret < 0) {
+			LOG_ERR("Download failed, cannot install [%d]", ret);
+			lcz_lwm2m_sw_mgmt_install_completed(obj_inst_id, ret);
+			return ret;
 		}
 	}
-	k_mutex_unlock(&cb_lock);
 
-	return ret;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	if (INST_VALID(obj_inst_id)) {
+		k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+		get_inst(obj_inst_id)->install_start = k_uptime_get();
+		get_inst(obj_inst_id)->stats.install_bytes = 0;
+		get_inst(obj_inst_id)->stats.install_time_ms = 0;
+		get_inst(obj_inst_id)->stats.install_rate = 0;
+		k_spin_unlock(&stats_lock, key);
+	}
+#endif
+
+	return post_event(obj_inst_id, LCZ_LWM2M_SW_MGMT_EVENT_INSTALL);
+}
+
+static int sw_mgmt_uninstall_exe_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	ARG_UNUSED(args);
+	ARG_UNUSED(args_len);
+
+	return post_event(obj_inst_id, LCZ_LWM2M_SW_MGMT_EVENT_UNINSTALL);
 }
 
 static void *read_ver_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
 			 size_t *data_len)
 {
-	sys_snode_t *node;
-	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
 	lcz_lwm2m_sw_mgmt_read_ver_cb_t cb;
 	char *ver_str;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERSION_CACHE)
+	struct sw_mgmt_inst *inst;
+	size_t len;
+#endif
 
 	ARG_UNUSED(res_id);
 	ARG_UNUSED(res_inst_id);
-	cb = NULL;
-	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE (&sw_mgmt_event_callback_list, node) {
-		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			/* Only allow one registered callback for this object instance.
-			 * Use the first registered instance (the callback used when creating the obj).
-			 */
-			cb = agent->read_ver_callback;
-			goto unlock;
+
+	cb = INST_VALID(obj_inst_id) ? get_inst(obj_inst_id)->read_ver_callback : NULL;
+	if (!cb) {
+		return NULL;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERSION_CACHE)
+	inst = get_inst(obj_inst_id);
+	/* Marked valid before the read, so a change reported during the read isn't lost */
+	if (!atomic_cas(&inst->ver_valid, 0, 1)) {
+		if (data_len) {
+			*data_len = inst->ver_len;
 		}
+		return inst->ver;
 	}
-unlock:
-	k_mutex_unlock(&cb_lock);
-	if (cb) {
-		ver_str = (char *)cb();
-		if (ver_str && data_len) {
-			*data_len = strlen(ver_str);
+
+	ver_str = (char *)cb();
+	if (!ver_str) {
+		atomic_clear(&inst->ver_valid);
+		return NULL;
+	}
+	len = strlen(ver_str);
+	if (len == 0) {
+		/* The version isn't known yet, read it again next time */
+		atomic_clear(&inst->ver_valid);
+		if (data_len) {
+			*data_len = 0;
 		}
 		return ver_str;
-	} else {
-		return NULL;
 	}
+	if (len >= sizeof(inst->ver)) {
+		LOG_WRN("Version of instance %d truncated", obj_inst_id);
+		len = sizeof(inst->ver) - 1;
+	}
+	memcpy(inst->ver, ver_str, len);
+	inst->ver[len] = '\0';
+	inst->ver_len = len;
+	if (data_len) {
+		*data_len = len;
+	}
+	return inst->ver;
+#else
+	ver_str = (char *)cb();
+	if (ver_str && data_len) {
+		*data_len = strlen(ver_str);
+	}
+	return ver_str;
+#endif
 }
 
-static int write_data_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id, uint8_t *data,
-			 uint16_t data_len, bool last_block, size_t total_size)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+static void verify_update(struct sw_mgmt_inst *inst, bool new_download, uint8_t *data,
+			  uint16_t data_len)
 {
-	sys_snode_t *node;
-	struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent;
-	lcz_lwm2m_sw_mgmt_download_data_cb_t cb;
+	struct sw_mgmt_verify *v = &inst->verify;
 
-	ARG_UNUSED(res_id);
-	ARG_UNUSED(res_inst_id);
+	if (new_download) {
+		v->offset = 0;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_CRC32)
+		v->crc = 0;
+#else
+		mbedtls_sha256_free(&v->sha);
+		mbedtls_sha256_init(&v->sha);
+		(void)mbedtls_sha256_starts(&v->sha, 0);
+#endif
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_CRC32)
+	v->crc = crc32_ieee_update(v->crc, data, data_len);
+#else
+	(void)mbedtls_sha256_update(&v->sha, data, data_len);
+#endif
+	v->offset += data_len;
+}
+
+static int verify_finish(struct sw_mgmt_inst *inst)
+{
+	int ret = 0;
+	struct sw_mgmt_verify *v = &inst->verify;
+	uint8_t digest[DIGEST_SIZE];
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY_CRC32)
+	sys_put_le32(v->crc, digest);
+#else
+	(void)mbedtls_sha256_finish(&v->sha, digest);
+#endif
+	v->offset = 0;
 
-	cb = NULL;
 	k_mutex_lock(&cb_lock, K_FOREVER);
-	SYS_SLIST_FOR_EACH_NODE(&sw_mgmt_event_callback_list, node) {
-		agent = CONTAINER_OF(node, struct lcz_lwm2m_sw_mgmt_event_callback_agent, node);
-		if (agent->event_callback != NULL && agent->obj_inst == obj_inst_id) {
-			/* Only allow one registered callback for this object instance.
-			 * Use the first registered instance (the callback used when creating the obj).
-			 */
-			cb = agent->download_data_callback;
-			goto unlock;
+	if (v->expected_set) {
+		/* The expected digest only applies to one package */
+		v->expected_set = false;
+		if (memcmp(digest, v->expected, sizeof(digest)) != 0) {
+			LOG_ERR("Package digest mismatch");
+			ret = -EBADMSG;
 		}
-	}
-unlock:
-	k_mutex_unlock(&cb_lock);
-	if (cb) {
-		return cb(data, data_len, last_block, total_size);
 	} else {
-		return -ENOEXEC;
+		LOG_DBG("No expected digest, package not verified");
 	}
+	k_mutex_unlock(&cb_lock);
+
+	return ret;
 }
+#endif
 
-/**************************************************************************************************/
-/* Global Function Definitions                                                                    */
-/**************************************************************************************************/
-int lcz_lwm2m_sw_mgmt_create_inst(uint16_t obj_inst,
-				  struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+/* Decide from the manifest alone whether the rest of the package is worth downloading */
+static int manifest_check(struct sw_mgmt_inst *inst, size_t total_size)
 {
-	int ret;
-	char obj_path[LWM2M_MAX_PATH_STR_LEN];
-	struct lwm2m_engine_obj_inst *inst;
+	struct lcz_lwm2m_sw_mgmt_manifest *m = &inst->manifest;
+	const char *installed;
+	bool compressed;
 
-	if (!agent->event_callback || !agent->read_ver_callback || !agent->download_data_callback) {
-		ret = -EINVAL;
-		goto exit;
+	if (total_size > 0 && m->header_size + m->payload_size != total_size) {
+		LOG_ERR("Manifest size %u doesn't match package size %u", m->payload_size,
+			total_size);
+		return -EBADMSG;
 	}
 
-	ret = lwm2m_create_obj_inst(LWM2M_OBJECT_SOFTWARE_MANAGEMENT_ID, obj_inst, &inst);
-	if (ret < 0) {
-		goto exit;
+	if (inst->target != NULL && strcmp(m->target, inst->target) != 0) {
+		LOG_ERR("Package is for target '%s'", m->target);
+		return -ENODEV;
 	}
 
-	snprintk(obj_path, sizeof(obj_path), "9/%d/1/0", obj_inst);
-	ret = lwm2m_engine_create_res_inst(obj_path);
-	if (ret < 0) {
-		goto exit;
+	installed = (const char *)inst->read_ver_callback();
+	if (installed != NULL && strcmp(m->version, installed) == 0) {
+		LOG_WRN("Version %s is already installed", m->version);
+		return -EALREADY;
 	}
 
-	ret = lwm2m_swmgmt_set_activate_cb(obj_inst, sw_mgmt_activate_exe_cb);
-	if (ret < 0) {
-		goto exit;
+	compressed = (m->flags & LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_HEATSHRINK) != 0;
+	if (compressed != (inst->compression != LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE)) {
+		LOG_ERR("Package compression doesn't match the instance");
+		return -ENOTSUP;
 	}
 
-	ret = lwm2m_swmgmt_set_deactivate_cb(obj_inst, sw_mgmt_deactivate_exe_cb);
-	if (ret < 0) {
-		goto exit;
+	if ((m->flags & LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_DELTA) != 0 &&
+	    (!IS_ENABLED(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA) || inst->source_read_callback == NULL)) {
+		LOG_ERR("Delta patches are not supported");
+		return -ENOTSUP;
 	}
 
-	ret = lwm2m_swmgmt_set_install_package_cb(obj_inst, sw_mgmt_install_exe_cb);
-	if (ret < 0) {
-		goto exit;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	if ((m->flags & LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_DIGEST) != 0) {
+		/* A cached image was verified when it was added */
+		inst->cache_entry = lcz_lwm2m_sw_mgmt_cache_lookup(m->digest);
+		if (inst->cache_entry >= 0) {
+			return 0;
+		}
+		(void)lcz_lwm2m_sw_mgmt_cache_fill_start(INST_ID(inst), m->digest,
+							 m->version);
 	}
+#endif
 
-	ret = lwm2m_swmgmt_set_delete_package_cb(obj_inst, sw_mgmt_uninstall_exe_cb);
-	if (ret < 0) {
-		goto exit;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	if ((m->flags & LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_DIGEST) != 0) {
+		k_mutex_lock(&cb_lock, K_FOREVER);
+		memcpy(inst->verify.expected, m->digest, DIGEST_SIZE);
+		inst->verify.expected_set = true;
+		k_mutex_unlock(&cb_lock);
 	}
+#endif
 
-	ret = lwm2m_swmgmt_set_read_package_version_cb(obj_inst, read_ver_cb);
-	if (ret < 0) {
-		goto exit;
+	LOG_INF("Package version %s, %u bytes", m->version, m->payload_size);
+	return 0;
+}
+
+/* Remove the manifest from the start of the package, leaving the payload for the pipeline */
+static int manifest_strip(struct sw_mgmt_inst *inst, bool new_download, uint8_t **data,
+			  size_t *data_len, bool last_block, size_t *total_size)
+{
+	int ret;
+	struct lcz_lwm2m_sw_mgmt_manifest *m = &inst->manifest;
+	const uint8_t *p = *data;
+	size_t n = *data_len;
+
+	if (new_download) {
+		m->header_size = 0;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+		inst->cache_entry = -ENOENT;
+		inst->cache_served = false;
+		(void)lcz_lwm2m_sw_mgmt_cache_fill_finish(INST_ID(inst), false);
+#endif
+		if (lcz_lwm2m_sw_mgmt_manifest_is_present(*data, *data_len)) {
+			lcz_lwm2m_sw_mgmt_manifest_start(m);
+		} else if (IS_ENABLED(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST_REQUIRED)) {
+			LOG_ERR("Package has no manifest");
+			return -EBADMSG;
+		} else {
+			m->active = false;
+		}
 	}
 
-	ret = lwm2m_swmgmt_set_write_package_cb(obj_inst, write_data_cb);
-	if (ret < 0) {
-		goto exit;
+	if (m->active) {
+		ret = lcz_lwm2m_sw_mgmt_manifest_parse(m, &p, &n);
+		if (ret == 0 && last_block) {
+			LOG_ERR("Package truncated in manifest");
+			ret = -EBADMSG;
+		}
+		if (ret < 0) {
+			return ret;
+		}
+		if (ret > 0) {
+			ret = manifest_check(inst, *total_size);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		*data = (uint8_t *)p;
+		*data_len = n;
 	}
 
-	agent->obj_inst = obj_inst;
-	sys_slist_append(&sw_mgmt_event_callback_list, &agent->node);
+	if (m->header_size > 0) {
+		*total_size = m->payload_size;
+	}
+	return 0;
+}
+#endif
 
-exit:
+static bool inst_created(struct sw_mgmt_inst *inst)
+{
+	return inst->download_data_callback != NULL || inst->download_data_v2_callback != NULL;
+}
+
+/* Pass image data to the backend. A v1 callback gets the chunks one at a time. */
+static int backend_write(struct sw_mgmt_inst *inst, size_t offset,
+			 const struct lcz_lwm2m_sw_mgmt_chunk *chunks, size_t chunk_count,
+			 bool last_block, size_t total_size)
+{
+	int ret = 0;
+	size_t i;
+	size_t pos;
+	uint16_t len;
+
+	if (inst->download_data_v2_callback != NULL) {
+		return inst->download_data_v2_callback(offset, chunks, chunk_count, last_block,
+						       total_size);
+	}
+
+	for (i = 0; i < chunk_count && ret >= 0; i++) {
+		pos = 0;
+		do {
+			len = MIN(chunks[i].len - pos, UINT16_MAX);
+			ret = inst->download_data_callback((uint8_t *)chunks[i].data + pos, len,
+							   last_block && (i == chunk_count - 1) &&
+								   (pos + len == chunks[i].len),
+							   total_size);
+			pos += len;
+		} while (ret >= 0 && pos < chunks[i].len);
+	}
 	return ret;
 }
 
-int lcz_lwm2m_sw_mgmt_register_event_callback(uint16_t obj_inst,
-					      struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+static int queue_download_data(uint16_t obj_inst_id, size_t offset, uint8_t *data,
+			       uint16_t data_len, bool last_block, size_t total_size)
 {
-	k_mutex_lock(&cb_lock, K_FOREVER);
-	agent->obj_inst = obj_inst;
-	sys_slist_append(&sw_mgmt_event_callback_list, &agent->node);
-	k_mutex_unlock(&cb_lock);
-	return 0;
+	int ret;
+	struct download_block *block;
+	atomic_t *download_err;
+	uint16_t chunk;
+
+	download_err = &get_inst(obj_inst_id)->download_err;
+
+	/* A failed write aborts the rest of the transfer. The error is kept until the next
+	 * download starts, so every later block and the install see it.
+	 */
+	ret = atomic_get(download_err);
+	if (ret < 0) {
+		return ret;
+	}
+
+	do {
+		chunk = MIN(data_len, ASYNC_BLOCK_SIZE);
+
+		/* Blocking here is the backpressure to the engine (and server) */
+		ret = k_mem_slab_alloc(&download_slab, (void **)&block, ASYNC_TIMEOUT);
+		if (ret < 0) {
+			LOG_ERR("Download queue full [%d]", ret);
+			return ret;
+		}
+
+		block->obj_inst = obj_inst_id;
+		block->data_len = chunk;
+		block->last_block = last_block && (chunk == data_len);
+		block->download_id = (uint32_t)atomic_get(&get_inst(obj_inst_id)->download_id);
+		block->offset = offset;
+		block->total_size = total_size;
+		memcpy(block->data, data, chunk);
+		data += chunk;
+		data_len -= chunk;
+		offset += chunk;
+
+		/* The msgq has as many slots as the slab, so this can't block */
+		(void)k_msgq_put(&download_msgq, &block, K_FOREVER);
+	} while (data_len > 0);
+
+	if (last_block) {
+		/* Report the result of the whole download to the engine */
+		ret = k_sem_take(&get_inst(obj_inst_id)->download_done, ASYNC_TIMEOUT);
+		if (ret < 0) {
+			LOG_ERR("Download writer timeout [%d]", ret);
+			return ret;
+		}
+		ret = atomic_get(download_err);
+	}
+
+	return ret;
 }
 
-int lcz_lwm2m_sw_mgmt_unregister_event_callback(
-	uint16_t obj_inst, struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+static void download_writer_thread(void *arg1, void *arg2, void *arg3)
 {
+	int ret;
+	struct download_block *batch[ASYNC_BATCH_COUNT];
+	struct lcz_lwm2m_sw_mgmt_chunk chunks[ASYNC_BATCH_COUNT];
+	struct download_block *next = NULL;
+	struct download_block *block;
+	struct sw_mgmt_inst *inst;
+	size_t count;
+	size_t i;
+	bool current;
+
+	ARG_UNUSED(arg1);
+	ARG_UNUSED(arg2);
+	ARG_UNUSED(arg3);
+
+	while (true) {
+		if (next == NULL) {
+			(void)k_msgq_get(&download_msgq, &next, K_FOREVER);
+		}
+		batch[0] = next;
+		next = NULL;
+		count = 1;
+
+		/* Blocks of the same image that are already queued go to the backend in one write.
+		 * A block that doesn't follow on is held for the next write.
+		 */
+		while (count < lcz_lwm2m_sw_mgmt_params()->async_batch &&
+		       !batch[count - 1]->last_block &&
+		       k_msgq_get(&download_msgq, &next, K_NO_WAIT) == 0) {
+			block = batch[count - 1];
+			if (next->obj_inst != block->obj_inst ||
+			    next->download_id != block->download_id ||
+			    next->offset != block->offset + block->data_len) {
+				break;
+			}
+			batch[count++] = next;
+			next = NULL;
+		}
+
+		block = batch[count - 1];
+		inst = get_inst(block->obj_inst);
+		/* A restart after an error can come while blocks of the failed download are queued.
+		 * They must not reach the backend or end the new download.
+		 */
+		current = (block->download_id == (uint32_t)atomic_get(&inst->download_id));
+
+		if (current && atomic_get(&inst->download_err) == 0) {
+			for (i = 0; i < count; i++) {
+				chunks[i].data = batch[i]->data;
+				chunks[i].len = batch[i]->data_len;
+			}
+			ret = backend_write(inst, batch[0]->offset, chunks, count,
+					    block->last_block, block->total_size);
+			if (ret < 0) {
+				LOG_ERR("Download write failed [%d]", ret);
+				(void)atomic_set(&inst->download_err, ret);
+			}
+		}
+
+		if (current && block->last_block) {
+			k_sem_give(&inst->download_done);
+		}
+		for (i = 0; i < count; i++) {
+			k_mem_slab_free(&download_slab, (void **)&batch[i]);
+		}
+	}
+}
+
+K_THREAD_DEFINE(download_writer, CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_STACK_SIZE,
+		download_writer_thread, NULL, NULL, NULL,
+		CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_THREAD_PRIORITY, 0, 0);
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+/* Pass the cached image to the backend once, then drop the rest of the transfer */
+static int cache_serve(uint16_t obj_inst_id, bool last_block)
+{
+	int ret = 0;
+	struct sw_mgmt_inst *inst = get_inst(obj_inst_id);
+
+	if (!inst->cache_served) {
+		inst->cache_served = true;
+		ret = lcz_lwm2m_sw_mgmt_cache_replay(inst->cache_entry, obj_inst_id,
+						     deliver_download_data);
+		if (ret < 0) {
+			LOG_ERR("Cached package replay failed [%d]", ret);
+		}
+	}
+
+	if (last_block || ret < 0) {
+		inst->cache_entry = -ENOENT;
+	}
+	return ret;
+}
+#endif
+
+static int deliver_download_data(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len,
+				 bool last_block, size_t total_size)
+{
+	struct sw_mgmt_inst *inst = get_inst(obj_inst_id);
+	size_t offset;
+#if !defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	struct lcz_lwm2m_sw_mgmt_chunk chunk = { .data = data, .len = data_len };
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	int ret;
+
+	/* The backend image is cached, so a hit doesn't need to decompress or patch again */
+	ret = lcz_lwm2m_sw_mgmt_cache_fill_write(obj_inst_id, data, data_len);
+	if (ret < 0) {
+		/* Caching is optional, the download goes on without it */
+		LOG_WRN("Package won't be cached [%d]", ret);
+	}
+#endif
+
+	/* Offsets follow the package where they can, so the backend sees a retransmission */
+	offset = image_transformed(inst) ? inst->tx_offset : inst->image_offset;
+	inst->tx_offset = last_block ? 0 : (offset + data_len);
+	inst->image_offset += data_len;
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	return queue_download_data(obj_inst_id, offset, data, data_len, last_block, total_size);
+#else
+	return backend_write(inst, offset, &chunk, 1, last_block, total_size);
+#endif
+}
+
+/* True when the image isn't a copy of the package payload, so its offsets don't follow the
+ * block position.
+ */
+static bool image_transformed(struct sw_mgmt_inst *inst)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	if (inst->cache_entry >= 0) {
+		return true;
+	}
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+	if (inst->compression != LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE) {
+		return true;
+	}
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+	if (delta.active && delta.obj_inst == INST_ID(inst)) {
+		return true;
+	}
+#endif
+	return false;
+}
+
+/* Bytes of the package in front of the image */
+static size_t package_header_size(struct sw_mgmt_inst *inst)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+	return inst->manifest.header_size;
+#else
+	ARG_UNUSED(inst);
+	return 0;
+#endif
+}
+
+/* A retransmitted block goes to a v2 backend at its own offset, so the backend can drop what it
+ * already has. Anything else can't place it in the image and it is dropped here.
+ */
+static int deliver_duplicate(struct sw_mgmt_inst *inst, size_t offset, uint8_t *data,
+			     uint16_t data_len, size_t total_size)
+{
+	size_t header = package_header_size(inst);
+#if !defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	struct lcz_lwm2m_sw_mgmt_chunk chunk;
+#endif
+
+	/* Image offset 0 starts a new image, so a block reaching back to the start of the image
+	 * (or into the header) isn't passed on. It was delivered before, dropping it is safe.
+	 */
+	if (inst->download_data_v2_callback == NULL || image_transformed(inst) ||
+	    offset <= header) {
+		return 0;
+	}
+
+	offset -= header;
+	total_size = (total_size > header) ? (total_size - header) : 0;
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	return queue_download_data(INST_ID(inst), offset, data, data_len, false, total_size);
+#else
+	chunk.data = data;
+	chunk.len = data_len;
+	return backend_write(inst, offset, &chunk, 1, false, total_size);
+#endif
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+static int delta_begin(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len)
+{
+	struct sw_mgmt_inst *inst = get_inst(obj_inst_id);
+
+	if (delta.active && delta.obj_inst == obj_inst_id) {
+		lcz_lwm2m_sw_mgmt_delta_abort(&delta);
+	}
+
+	if (!lcz_lwm2m_sw_mgmt_delta_is_patch(data, data_len)) {
+		return 0;
+	}
+
+	if (delta.active) {
+		LOG_ERR("Delta patch already in progress for instance %d", delta.obj_inst);
+		return -EBUSY;
+	}
+
+	LOG_INF("Applying delta patch");
+	return lcz_lwm2m_sw_mgmt_delta_start(&delta, obj_inst_id,
+					     (const char *)inst->read_ver_callback(),
+					     inst->source_read_callback, deliver_download_data);
+}
+#endif
+
+/* Stage after decompression: rebuild delta patches, pass everything else through */
+static int patch_download_data(uint16_t obj_inst_id, uint8_t *data, uint16_t data_len,
+			       bool last_block, size_t total_size)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DELTA)
+	int ret;
+	struct sw_mgmt_inst *inst = get_inst(obj_inst_id);
+
+	if (inst->patch_start) {
+		inst->patch_start = false;
+		ret = delta_begin(obj_inst_id, data, data_len);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (delta.active && delta.obj_inst == obj_inst_id) {
+		return lcz_lwm2m_sw_mgmt_delta_write(&delta, data, data_len, last_block);
+	}
+#endif
+
+	return deliver_download_data(obj_inst_id, data, data_len, last_block, total_size);
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+static int decompress_begin(uint16_t obj_inst_id)
+{
+	if (decompress.active && decompress.obj_inst == obj_inst_id) {
+		lcz_lwm2m_sw_mgmt_decompress_abort(&decompress);
+	}
+
+	if (get_inst(obj_inst_id)->compression == LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE) {
+		return 0;
+	}
+
+	if (decompress.active) {
+		LOG_ERR("Decompression already in progress for instance %d", decompress.obj_inst);
+		return -EBUSY;
+	}
+
+	return lcz_lwm2m_sw_mgmt_decompress_start(&decompress, obj_inst_id, patch_download_data);
+}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+static void stats_block(struct sw_mgmt_inst *inst, bool new_download, uint16_t data_len,
+			bool last_block, uint32_t start_cycles, int result)
+{
+	struct lcz_lwm2m_sw_mgmt_stats *stats = &inst->stats;
+	uint32_t time_us;
+	uint32_t bin;
+	int64_t now;
+	k_spinlock_key_t key;
+
+	time_us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cycles);
+	bin = MIN(find_msb_set(time_us >> 7), LCZ_LWM2M_SW_MGMT_STATS_HIST_BINS - 1);
+	now = k_uptime_get();
+
+	key = k_spin_lock(&stats_lock);
+	if (new_download) {
+		inst->download_start = now;
+		stats->bytes_received = 0;
+		stats->blocks_received = 0;
+		stats->download_time_ms = 0;
+	}
+	stats->bytes_received += data_len;
+	stats->blocks_received++;
+	stats->blocks_total++;
+	stats->block_time_total_us += time_us;
+	stats->block_time_max_us = MAX(stats->block_time_max_us, time_us);
+	stats->block_time_hist[bin]++;
+	stats->download_time_ms = (uint32_t)(now - inst->download_start);
+	if (last_block && result == 0) {
+		stats->downloads++;
+		stats->download_rate =
+			(uint32_t)(((uint64_t)stats->bytes_received * MSEC_PER_SEC) /
+				   MAX(stats->download_time_ms, 1));
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void stats_failure(struct sw_mgmt_inst *inst, lcz_lwm2m_sw_mgmt_failure_t failure)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	inst->stats.failures[failure]++;
+	k_spin_unlock(&stats_lock, key);
+}
+#endif
+
+static int write_data_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id, uint8_t *data,
+			 uint16_t data_len, bool last_block, size_t total_size)
+{
+	int ret;
+	struct sw_mgmt_inst *inst;
+	bool new_download;
+	bool payload_start;
+	uint8_t *payload = data;
+	size_t payload_len = data_len;
+	size_t payload_size = total_size;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	uint32_t start_cycles = k_cycle_get_32();
+#endif
+
+	ARG_UNUSED(res_id);
+	ARG_UNUSED(res_inst_id);
+
+	if (!INST_VALID(obj_inst_id) || !inst_created(get_inst(obj_inst_id))) {
+		return -ENOEXEC;
+	}
+	inst = get_inst(obj_inst_id);
+
+	/* Same restart detection as the backends: a block past the end starts a new download */
+	new_download = (inst->rx_offset == 0) ||
+		       (total_size > 0 && (inst->rx_offset + data_len) > total_size);
+	if (new_download) {
+		inst->rx_offset = 0;
+		inst->tx_offset = 0;
+		inst->patch_start = true;
+		inst->payload_start = true;
+		lcz_lwm2m_sw_mgmt_params_load();
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+		/* Drop the result of an earlier download, including a give that came after its
+		 * last block timed out.
+		 */
+		(void)atomic_inc(&inst->download_id);
+		(void)atomic_set(&inst->download_err, 0);
+		k_sem_reset(&inst->download_done);
+#endif
+	}
+	SW_MGMT_TRACE_BLOCK(obj_inst_id, inst->rx_offset);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+	ret = manifest_strip(inst, new_download, &payload, &payload_len, last_block, &payload_size);
+	if (ret < 0) {
+		/* Abort now rather than after the whole package has been stored */
+		inst->rx_offset = 0;
+		SW_MGMT_TRACE_DOWNLOAD_DONE(obj_inst_id, ret);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+		stats_failure(inst, LCZ_LWM2M_SW_MGMT_FAILURE_REJECTED);
+		stats_block(inst, new_download, data_len, last_block, start_cycles, ret);
+#endif
+		return ret;
+	}
+
+	if (payload_len == 0 && !last_block) {
+		/* The block only carried the manifest */
+		inst->rx_offset += data_len;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+		stats_block(inst, new_download, data_len, last_block, start_cycles, 0);
+#endif
+		return 0;
+	}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	if (inst->cache_entry >= 0) {
+		ret = cache_serve(obj_inst_id, last_block);
+		inst->rx_offset = (last_block || ret < 0) ? 0 : (inst->rx_offset + data_len);
+		if (last_block || ret < 0) {
+			SW_MGMT_TRACE_DOWNLOAD_DONE(obj_inst_id, ret);
+		}
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+		stats_block(inst, new_download, data_len, last_block, start_cycles, ret);
+#endif
+		return ret;
+	}
+#endif
+
+	payload_start = inst->payload_start;
+	inst->payload_start = false;
+	inst->image_offset = inst->rx_offset + (data_len - payload_len) - package_header_size(inst);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	verify_update(inst, payload_start, payload, payload_len);
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS)
+	/* A failed start goes through the same error handling as a failed write */
+	ret = payload_start ? decompress_begin(obj_inst_id) : 0;
+	if (ret == 0 && inst->compression != LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE) {
+		ret = lcz_lwm2m_sw_mgmt_decompress_write(&decompress, payload, payload_len,
+							 last_block);
+	} else if (ret == 0) {
+		ret = patch_download_data(obj_inst_id, payload, payload_len, last_block,
+					  payload_size);
+	}
+#else
+	ARG_UNUSED(payload_start);
+	ret = patch_download_data(obj_inst_id, payload, payload_len, last_block, payload_size);
+#endif
+
+	inst->rx_offset = last_block ? 0 : (inst->rx_offset + data_len);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	if (ret < 0) {
+		stats_failure(inst, LCZ_LWM2M_SW_MGMT_FAILURE_DOWNLOAD);
+	}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	if (ret == 0 && last_block) {
+		ret = verify_finish(inst);
+		if (ret < 0) {
+			/* Reject the install without re-reading the package from storage */
+			(void)atomic_set(&inst->download_err, ret);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+			stats_failure(inst, LCZ_LWM2M_SW_MGMT_FAILURE_VERIFY);
+#endif
+		}
+	}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	/* Only verified packages are cached */
+	if (ret < 0 || last_block) {
+		(void)lcz_lwm2m_sw_mgmt_cache_fill_finish(obj_inst_id, ret == 0);
+	}
+#endif
+
+	if (last_block || ret < 0) {
+		SW_MGMT_TRACE_DOWNLOAD_DONE(obj_inst_id, ret);
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	stats_block(inst, new_download, data_len, last_block, start_cycles, ret);
+#endif
+
+	return ret;
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+/* Blocks written by the server, which can't share the package with a pull */
+static int push_write_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			 uint8_t *data, uint16_t data_len, bool last_block, size_t total_size)
+{
+	int ret;
+	struct sw_mgmt_inst *inst;
+
+	if (!INST_VALID(obj_inst_id)) {
+		return -ENOEXEC;
+	}
+	inst = get_inst(obj_inst_id);
+
+	/* Marked before checking for a pull, lcz_lwm2m_sw_mgmt_pull_begin() does the reverse */
+	inst->push_time = k_uptime_get_32();
+	(void)atomic_set(&inst->pushing, 1);
+	if (atomic_get(&inst->pulling)) {
+		LOG_ERR("Pull download in progress on instance %d", obj_inst_id);
+		(void)atomic_set(&inst->pushing, 0);
+		return -EBUSY;
+	}
+
+	ret = write_data_cb(obj_inst_id, res_id, res_inst_id, data, data_len, last_block,
+			    total_size);
+	if (ret < 0 || last_block) {
+		(void)atomic_set(&inst->pushing, 0);
+	}
+	return ret;
+}
+
+/* The engine only moves the state when the server writes the package, so a pull sets it */
+static int set_update_state(uint16_t obj_inst, uint8_t state, uint8_t result)
+{
+	int ret;
+
+	RES_PATH_DEFINE(state_path, obj_inst, "7");
+	RES_PATH_DEFINE(result_path, obj_inst, "9");
+	ret = lwm2m_engine_set_u8(result_path, result);
+	if (ret == 0) {
+		ret = lwm2m_engine_set_u8(state_path, state);
+	}
+	if (ret < 0) {
+		LOG_ERR("Could not set update state %d [%d]", state, ret);
+	}
+	return ret;
+}
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_create_inst(uint16_t obj_inst,
+				  struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+{
+	int ret;
+	struct lwm2m_engine_obj_inst *inst;
+	struct sw_mgmt_inst *sw;
+
+	if (!agent->event_callback || !agent->read_ver_callback ||
+	    (!agent->download_data_callback && !agent->download_data_v2_callback)) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if (!INST_VALID(obj_inst)) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if (!IS_ENABLED(CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS) &&
+	    agent->compression != LCZ_LWM2M_SW_MGMT_COMPRESSION_NONE) {
+		ret = -ENOTSUP;
+		goto exit;
+	}
+
+	sw = get_inst(obj_inst);
+	if (inst_created(sw)) {
+		ret = -EALREADY;
+		goto exit;
+	}
+
+	ret = lwm2m_create_obj_inst(LWM2M_OBJECT_SOFTWARE_MANAGEMENT_ID, obj_inst, &inst);
+	if (ret < 0) {
+		goto exit;
+	}
+
+	RES_PATH_DEFINE(obj_path, obj_inst, "1/0");
+	ret = lwm2m_engine_create_res_inst(obj_path);
+	if (ret < 0) {
+		goto delete_inst;
+	}
+
+	/* Resolve the single-owner callbacks before the engine can call into this instance */
+	sw->read_ver_callback = agent->read_ver_callback;
+	sw->download_data_callback = agent->download_data_callback;
+	sw->download_data_v2_callback = agent->download_data_v2_callback;
+	sw->source_read_callback = agent->source_read_callback;
+	sw->compression = agent->compression;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_MANIFEST)
+	sw->target = agent->target;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	sw->cache_entry = -ENOENT;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	k_sem_init(&sw->download_done, 0, 1);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	k_sem_init(&sw->event_done, 0, K_SEM_MAX_LIMIT);
+#endif
+
+	ret = lwm2m_swmgmt_set_activate_cb(obj_inst, sw_mgmt_activate_exe_cb);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+	ret = lwm2m_swmgmt_set_deactivate_cb(obj_inst, sw_mgmt_deactivate_exe_cb);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+	ret = lwm2m_swmgmt_set_install_package_cb(obj_inst, sw_mgmt_install_exe_cb);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+	ret = lwm2m_swmgmt_set_delete_package_cb(obj_inst, sw_mgmt_uninstall_exe_cb);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+	ret = lwm2m_swmgmt_set_read_package_version_cb(obj_inst, read_ver_cb);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+	ret = lwm2m_swmgmt_set_write_package_cb(obj_inst, push_write_cb);
+#else
+	ret = lwm2m_swmgmt_set_write_package_cb(obj_inst, write_data_cb);
+#endif
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+	agent->obj_inst = obj_inst;
+	sw->event_callback = agent->event_callback;
+#else
+	ret = lcz_lwm2m_sw_mgmt_register_event_callback(obj_inst, agent);
+	if (ret < 0) {
+		goto clear_cbs;
+	}
+#endif
+	return 0;
+
+clear_cbs:
+	/* Otherwise the instance looks created and a retry fails with -EALREADY */
+	sw->read_ver_callback = NULL;
+	sw->download_data_callback = NULL;
+	sw->download_data_v2_callback = NULL;
+	sw->source_read_callback = NULL;
+delete_inst:
+	(void)lwm2m_delete_obj_inst(LWM2M_OBJECT_SOFTWARE_MANAGEMENT_ID, obj_inst);
+exit:
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_register_event_callback(uint16_t obj_inst,
+					      struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+{
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+	ARG_UNUSED(agent);
+	return -ENOTSUP;
+#else
+
 	k_mutex_lock(&cb_lock, K_FOREVER);
-	(void)sys_slist_find_and_remove(&sw_mgmt_event_callback_list, &agent->node);
+	agent->obj_inst = obj_inst;
+	sys_slist_append(&get_inst(obj_inst)->event_callback_list, &agent->node);
 	k_mutex_unlock(&cb_lock);
 	return 0;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_unregister_event_callback(
+	uint16_t obj_inst, struct lcz_lwm2m_sw_mgmt_event_callback_agent *agent)
+{
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATIC)
+	ARG_UNUSED(agent);
+	return -ENOTSUP;
+#else
+	k_mutex_lock(&cb_lock, K_FOREVER);
+	(void)sys_slist_find_and_remove(&get_inst(obj_inst)->event_callback_list, &agent->node);
+	k_mutex_unlock(&cb_lock);
+	return 0;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_write_package(uint16_t obj_inst, size_t offset, uint8_t *data,
+				    uint16_t data_len, bool last_block, size_t total_size)
+{
+	int ret;
+	struct sw_mgmt_inst *inst;
+	uint16_t dup;
+
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+	inst = get_inst(obj_inst);
+
+	if (offset == 0) {
+		inst->rx_offset = 0;
+	} else if (offset < inst->rx_offset) {
+		/* Only the part not received yet goes through the pipeline */
+		dup = MIN(inst->rx_offset - offset, data_len);
+		ret = deliver_duplicate(inst, offset, data, dup, total_size);
+		if (ret < 0 || dup == data_len) {
+			return ret;
+		}
+		data += dup;
+		data_len -= dup;
+	} else if (offset != inst->rx_offset) {
+		return -EINVAL;
+	}
+
+	ret = write_data_cb(obj_inst, PACKAGE_RES_ID, 0, data, data_len, last_block, total_size);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_CACHE)
+	if (ret == 0 && inst->cache_served && inst->cache_entry >= 0) {
+		/* Unlike the engine, the caller can stop the transfer */
+		inst->cache_entry = -ENOENT;
+		inst->rx_offset = 0;
+		ret = LCZ_LWM2M_SW_MGMT_WRITE_CACHED;
+	}
+#endif
+	return ret;
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+int lcz_lwm2m_sw_mgmt_pull_begin(uint16_t obj_inst)
+{
+	struct sw_mgmt_inst *inst;
+
+	if (!INST_VALID(obj_inst) || !inst_created(get_inst(obj_inst))) {
+		return -EINVAL;
+	}
+	inst = get_inst(obj_inst);
+
+	if (!atomic_cas(&inst->pulling, 0, 1)) {
+		return -EBUSY;
+	}
+	if (atomic_get(&inst->pushing) && (k_uptime_get_32() - inst->push_time) < PUSH_IDLE_MS) {
+		LOG_ERR("Push download in progress on instance %d", obj_inst);
+		(void)atomic_set(&inst->pulling, 0);
+		return -EBUSY;
+	}
+	(void)atomic_set(&inst->pushing, 0);
+
+	(void)set_update_state(obj_inst, UPDATE_STATE_DOWNLOAD_STARTED, UPDATE_RESULT_DOWNLOADING);
+	return 0;
+}
+
+void lcz_lwm2m_sw_mgmt_pull_end(uint16_t obj_inst, int result)
+{
+	uint8_t update_result;
+
+	if (!INST_VALID(obj_inst)) {
+		return;
+	}
+
+	if (result == 0) {
+		/* Same as a package written by the server, an install may follow */
+		(void)set_update_state(obj_inst, UPDATE_STATE_DELIVERED, UPDATE_RESULT_DOWNLOADED);
+	} else {
+		switch (result) {
+		case -ENOSPC:
+			update_result = UPDATE_RESULT_NO_STORAGE;
+			break;
+		case -ENOMEM:
+			update_result = UPDATE_RESULT_OUT_OF_MEMORY;
+			break;
+		case -EBADMSG:
+			update_result = UPDATE_RESULT_INTEGRITY_FAILURE;
+			break;
+		case -ETIMEDOUT:
+		case -ECONNREFUSED:
+		case -ECONNRESET:
+		case -ENETUNREACH:
+			update_result = UPDATE_RESULT_CONNECTION_LOST;
+			break;
+		case -ECANCELED:
+			update_result = UPDATE_RESULT_INITIAL;
+			break;
+		default:
+			update_result = UPDATE_RESULT_DEVICE_ERROR;
+			break;
+		}
+		(void)set_update_state(obj_inst, UPDATE_STATE_INITIAL, update_result);
+	}
+	(void)atomic_set(&get_inst(obj_inst)->pulling, 0);
+}
+#endif
+
+int lcz_lwm2m_sw_mgmt_set_expected_digest(uint16_t obj_inst, const uint8_t *digest,
+					  size_t digest_len)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	struct sw_mgmt_verify *v;
+
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+	if (digest_len != 0 && (digest == NULL || digest_len != DIGEST_SIZE)) {
+		return -EINVAL;
+	}
+
+	v = &get_inst(obj_inst)->verify;
+	k_mutex_lock(&cb_lock, K_FOREVER);
+	if (digest_len != 0) {
+		memcpy(v->expected, digest, DIGEST_SIZE);
+	}
+	v->expected_set = (digest_len != 0);
+	k_mutex_unlock(&cb_lock);
+	return 0;
+#else
+	ARG_UNUSED(obj_inst);
+	ARG_UNUSED(digest);
+	ARG_UNUSED(digest_len);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_install_completed(uint16_t obj_inst, int error_code)
+{
+	int ret;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	struct sw_mgmt_inst *inst;
+	k_spinlock_key_t key;
+
+	if (INST_VALID(obj_inst)) {
+		inst = get_inst(obj_inst);
+		key = k_spin_lock(&stats_lock);
+		inst->stats.install_time_ms = (uint32_t)(k_uptime_get() - inst->install_start);
+		if (error_code < 0) {
+			inst->stats.failures[LCZ_LWM2M_SW_MGMT_FAILURE_INSTALL]++;
+		} else {
+			inst->stats.installs++;
+		}
+		k_spin_unlock(&stats_lock, key);
+	}
+#endif
+
+	lcz_lwm2m_sw_mgmt_version_changed(obj_inst);
+	SW_MGMT_TRACE_COMPLETE(obj_inst, error_code);
+	ret = lwm2m_swmgmt_install_completed(obj_inst, error_code);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+	/* After the engine has the result, so the next install starts from a settled object */
+	lcz_lwm2m_sw_mgmt_sched_completed(obj_inst, error_code);
+#endif
+	return ret;
+}
+
+uint32_t lcz_lwm2m_sw_mgmt_event_seq(uint16_t obj_inst)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	return INST_VALID(obj_inst) ? get_inst(obj_inst)->event_seq : 0;
+#else
+	ARG_UNUSED(obj_inst);
+	return 0;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_event_complete(uint16_t obj_inst, uint32_t seq, int result)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_EVENT_BUS)
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+
+	return event_complete(get_inst(obj_inst), seq, result);
+#else
+	ARG_UNUSED(obj_inst);
+	ARG_UNUSED(seq);
+	ARG_UNUSED(result);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_get_stats(uint16_t obj_inst, struct lcz_lwm2m_sw_mgmt_stats *stats)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	k_spinlock_key_t key;
+
+	if (!INST_VALID(obj_inst) || stats == NULL) {
+		return -EINVAL;
+	}
+	if (!inst_created(get_inst(obj_inst))) {
+		return -ENOENT;
+	}
+
+	key = k_spin_lock(&stats_lock);
+	*stats = get_inst(obj_inst)->stats;
+	k_spin_unlock(&stats_lock, key);
+	return 0;
+#else
+	ARG_UNUSED(obj_inst);
+	ARG_UNUSED(stats);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_reset_stats(uint16_t obj_inst)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	k_spinlock_key_t key;
+
+	if (!INST_VALID(obj_inst)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&stats_lock);
+	memset(&get_inst(obj_inst)->stats, 0, sizeof(get_inst(obj_inst)->stats));
+	k_spin_unlock(&stats_lock, key);
+	return 0;
+#else
+	ARG_UNUSED(obj_inst);
+	return -ENOTSUP;
+#endif
+}
+
+void lcz_lwm2m_sw_mgmt_stats_storage_write(uint16_t obj_inst, uint32_t time_us, int result)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	struct lcz_lwm2m_sw_mgmt_stats *stats;
+	k_spinlock_key_t key;
+
+	if (!INST_VALID(obj_inst)) {
+		return;
+	}
+
+	stats = &get_inst(obj_inst)->stats;
+	key = k_spin_lock(&stats_lock);
+	if (result < 0) {
+		stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_STORAGE]++;
+	} else {
+		stats->storage_writes++;
+		stats->storage_write_total_us += time_us;
+		stats->storage_write_max_us = MAX(stats->storage_write_max_us, time_us);
+	}
+	k_spin_unlock(&stats_lock, key);
+#else
+	ARG_UNUSED(obj_inst);
+	ARG_UNUSED(time_us);
+	ARG_UNUSED(result);
+#endif
+}
+
+void lcz_lwm2m_sw_mgmt_stats_install_progress(uint16_t obj_inst, size_t bytes)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	struct sw_mgmt_inst *inst;
+	uint32_t elapsed;
+	k_spinlock_key_t key;
+
+	if (!INST_VALID(obj_inst)) {
+		return;
+	}
+
+	inst = get_inst(obj_inst);
+	key = k_spin_lock(&stats_lock);
+	elapsed = (uint32_t)(k_uptime_get() - inst->install_start);
+	inst->stats.install_bytes = bytes;
+	inst->stats.install_time_ms = elapsed;
+	inst->stats.install_rate = (uint32_t)(((uint64_t)bytes * MSEC_PER_SEC) / MAX(elapsed, 1));
+	k_spin_unlock(&stats_lock, key);
+#else
+	ARG_UNUSED(obj_inst);
+	ARG_UNUSED(bytes);
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_package_id(uint16_t obj_inst, uint32_t *id)
+{
+	int ret;
+	char uri[PACKAGE_URI_MAX_LEN + 1];
+
+	if (!INST_VALID(obj_inst) || id == NULL) {
+		return -EINVAL;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERIFY)
+	k_mutex_lock(&cb_lock, K_FOREVER);
+	if (get_inst(obj_inst)->verify.expected_set) {
+		*id = crc32_ieee(get_inst(obj_inst)->verify.expected, DIGEST_SIZE);
+		k_mutex_unlock(&cb_lock);
+		return 0;
+	}
+	k_mutex_unlock(&cb_lock);
+#endif
+
+	RES_PATH_DEFINE(uri_path, obj_inst, "3");
+	ret = lwm2m_engine_get_string(uri_path, uri, sizeof(uri));
+	if (ret < 0) {
+		return ret;
+	}
+	uri[sizeof(uri) - 1] = '\0';
+	if (uri[0] == '\0') {
+		return -ENOENT;
+	}
+
+	*id = crc32_ieee((uint8_t *)uri, strlen(uri));
+	return 0;
+}
+
+int lcz_lwm2m_sw_mgmt_update(uint16_t obj_inst, const struct lcz_lwm2m_sw_mgmt_update *update)
+{
+	int ret = 0;
+
+	if (!INST_VALID(obj_inst) || update == NULL) {
+		return -EINVAL;
+	}
+
+	/* Without the lock more than one resource can't be written as a single notification */
+	if (!REGISTRY_LOCKABLE && (update->fields & (update->fields - 1)) != 0) {
+		return -ENOTSUP;
+	}
+
+	/* Observers are notified once the engine thread runs again */
+	REGISTRY_LOCK();
+	if (update->fields & LCZ_LWM2M_SW_MGMT_UPDATE_PKG_NAME) {
+		RES_PATH_DEFINE(name_path, obj_inst, "0");
+		ret = lwm2m_engine_set_string(name_path, (char *)update->pkg_name);
+		if (ret < 0) {
+			goto exit;
+		}
+	}
+	if (update->fields & LCZ_LWM2M_SW_MGMT_UPDATE_PKG_VERSION) {
+		RES_PATH_DEFINE(version_path, obj_inst, "1");
+		ret = lwm2m_engine_set_string(version_path, (char *)update->pkg_version);
+		if (ret < 0) {
+			goto exit;
+		}
+	}
+	if (update->fields & LCZ_LWM2M_SW_MGMT_UPDATE_ACTIVATE) {
+		RES_PATH_DEFINE(activate_path, obj_inst, "12");
+		ret = lwm2m_engine_set_bool(activate_path, update->activate);
+	}
+
+exit:
+	REGISTRY_UNLOCK();
+	return ret;
+}
+
+void lcz_lwm2m_sw_mgmt_version_changed(uint16_t obj_inst)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_VERSION_CACHE)
+	if (INST_VALID(obj_inst)) {
+		atomic_clear(&get_inst(obj_inst)->ver_valid);
+	}
+#else
+	ARG_UNUSED(obj_inst);
+#endif
 }
 
 int lcz_lwm2m_sw_mgmt_set_pkg_name(uint16_t obj_inst, char *value)
 {
-	char obj_path[LWM2M_MAX_PATH_STR_LEN];
+	struct lcz_lwm2m_sw_mgmt_update update = {
+		.fields = LCZ_LWM2M_SW_MGMT_UPDATE_PKG_NAME,
+		.pkg_name = value,
+	};
 
-	snprintk(obj_path, sizeof(obj_path), "9/%d/0", obj_inst);
-	return lwm2m_engine_set_string(obj_path, value);
+	return lcz_lwm2m_sw_mgmt_update(obj_inst, &update);
 }
 
 int lcz_lwm2m_sw_mgmt_set_pkg_version(uint16_t obj_inst, char *value)
 {
-	char obj_path[LWM2M_MAX_PATH_STR_LEN];
+	struct lcz_lwm2m_sw_mgmt_update update = {
+		.fields = LCZ_LWM2M_SW_MGMT_UPDATE_PKG_VERSION,
+		.pkg_version = value,
+	};
 
-	snprintk(obj_path, sizeof(obj_path), "9/%d/1", obj_inst);
-	return lwm2m_engine_set_string(obj_path, value);
+	return lcz_lwm2m_sw_mgmt_update(obj_inst, &update);
 }
 
 int lcz_lwm2m_sw_mgmt_set_activate_state(uint16_t obj_inst, bool activate)
 {
-	char obj_path[LWM2M_MAX_PATH_STR_LEN];
+	struct lcz_lwm2m_sw_mgmt_update update = {
+		.fields = LCZ_LWM2M_SW_MGMT_UPDATE_ACTIVATE,
+		.activate = activate,
+	};
 
-	snprintk(obj_path, sizeof(obj_path), "9/%d/12", obj_inst);
-	return lwm2m_engine_set_bool(obj_path, activate);
+	return lcz_lwm2m_sw_mgmt_update(obj_inst, &update);
 }
@@ -0,0 +1,436 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_cache.c
+ * @brief Package cache
+ *
+ * Images are stored in CONFIG_FSU_MOUNT_POINT as <prefix>_<entry>.bin, indexed by
+ * <prefix>.idx. Each entry is keyed by the digest of the package it was built from and has a use
+ * sequence number for least recently used eviction.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_cache, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/crc.h>
+#include <file_system_utilities.h>
+
+#include "lcz_lwm2m_sw_mgmt_cache.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define CACHE_ENTRIES CONFIG_LCZ_LWM2M_SW_MGMT_CACHE_ENTRIES
+#define CACHE_MAX_SIZE CONFIG_LCZ_LWM2M_SW_MGMT_CACHE_MAX_SIZE
+#define CACHE_PATH_PREFIX CONFIG_FSU_MOUNT_POINT "/" CONFIG_LCZ_LWM2M_SW_MGMT_CACHE_PREFIX
+#define INDEX_PATH CACHE_PATH_PREFIX ".idx"
+#define FILL_PATH CACHE_PATH_PREFIX ".tmp"
+#define INDEX_MAGIC 0x534d4348 /* "SMCH" */
+/* Prefix, separator, entry number and extension */
+#define ENTRY_PATH_SIZE (sizeof(CACHE_PATH_PREFIX) + 8)
+#define VERSION_SIZE 33
+
+struct cache_entry {
+	uint8_t key[LCZ_LWM2M_SW_MGMT_CACHE_KEY_SIZE];
+	char version[VERSION_SIZE];
+	bool valid;
+	uint32_t size;
+	/* Index sequence number of the last use */
+	uint32_t used;
+};
+
+/* Persisted as one file so an entry is never half added */
+struct cache_index {
+	uint32_t magic;
+	uint32_t seq;
+	struct cache_entry entries[CACHE_ENTRIES];
+	/* CRC of the fields above */
+	uint32_t crc;
+};
+
+struct cache_fill {
+	bool active;
+	uint16_t obj_inst;
+	uint8_t key[LCZ_LWM2M_SW_MGMT_CACHE_KEY_SIZE];
+	char version[VERSION_SIZE];
+	/* Image bytes received, including those still in buf */
+	size_t size;
+	/* Image bytes not yet appended to the fill file */
+	size_t buf_len;
+	uint8_t buf[CONFIG_LCZ_LWM2M_SW_MGMT_CACHE_FILL_BUF_SIZE];
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static uint32_t index_crc(struct cache_index *idx);
+static int index_load(void);
+static int index_save(void);
+static void entry_path(int entry, char *path, size_t path_len);
+static void entry_evict(int entry);
+static int entry_alloc(size_t size);
+static int fill_flush(void);
+static void fill_abort(void);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct cache_index cache_idx;
+static bool index_loaded;
+static struct cache_fill fill;
+static K_MUTEX_DEFINE(cache_lock);
+/* Replays in progress per entry, a pinned entry isn't evicted */
+static uint8_t pins[CACHE_ENTRIES];
+/* Only serializes use of the replay buffer, the backend is called without cache_lock */
+static K_MUTEX_DEFINE(replay_lock);
+static uint8_t replay_buf[CONFIG_LCZ_LWM2M_SW_MGMT_CACHE_REPLAY_BUF_SIZE];
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static uint32_t index_crc(struct cache_index *idx)
+{
+	return crc32_ieee((uint8_t *)idx, offsetof(struct cache_index, crc));
+}
+
+/* The file system may be mounted after this module starts, so the index is loaded on first use */
+static int index_load(void)
+{
+	int ret;
+	int i;
+	char path[ENTRY_PATH_SIZE];
+
+	if (index_loaded) {
+		return 0;
+	}
+
+	ret = fsu_read_abs(INDEX_PATH, &cache_idx, sizeof(cache_idx));
+	if (ret != sizeof(cache_idx) || cache_idx.magic != INDEX_MAGIC ||
+	    cache_idx.crc != index_crc(&cache_idx)) {
+		memset(&cache_idx, 0, sizeof(cache_idx));
+		cache_idx.magic = INDEX_MAGIC;
+	}
+
+	/* Drop entries whose image is missing or incomplete */
+	for (i = 0; i < CACHE_ENTRIES; i++) {
+		if (cache_idx.entries[i].valid) {
+			entry_path(i, path, sizeof(path));
+			ret = fsu_get_file_size_abs(path);
+			if (ret < 0 || (uint32_t)ret != cache_idx.entries[i].size) {
+				cache_idx.entries[i].valid = false;
+			}
+		}
+	}
+
+	index_loaded = true;
+	return 0;
+}
+
+static int index_save(void)
+{
+	int ret;
+
+	cache_idx.crc = index_crc(&cache_idx);
+	ret = fsu_write_abs(INDEX_PATH, &cache_idx, sizeof(cache_idx));
+	if (ret < 0) {
+		LOG_ERR("Could not save cache index [%d]", ret);
+		return ret;
+	}
+	return 0;
+}
+
+static void entry_path(int entry, char *path, size_t path_len)
+{
+	snprintk(path, path_len, "%s_%d.bin", CACHE_PATH_PREFIX, entry);
+}
+
+static void entry_evict(int entry)
+{
+	char path[ENTRY_PATH_SIZE];
+
+	LOG_INF("Evicting cached package %s", cache_idx.entries[entry].version);
+	cache_idx.entries[entry].valid = false;
+	entry_path(entry, path, sizeof(path));
+	(void)fsu_delete_abs(path);
+}
+
+/* Free the least recently used entries until the image fits, then return a free entry */
+static int entry_alloc(size_t size)
+{
+	size_t total;
+	int lru;
+	int free_entry;
+	int i;
+
+	while (true) {
+		total = size;
+		lru = -1;
+		free_entry = -1;
+		for (i = 0; i < CACHE_ENTRIES; i++) {
+			if (!cache_idx.entries[i].valid) {
+				free_entry = i;
+				continue;
+			}
+			total += cache_idx.entries[i].size;
+			if (pins[i] > 0) {
+				continue;
+			}
+			if (lru < 0 || cache_idx.entries[i].used < cache_idx.entries[lru].used) {
+				lru = i;
+			}
+		}
+
+		if (free_entry >= 0 && total <= CACHE_MAX_SIZE) {
+			return free_entry;
+		}
+		if (lru < 0) {
+			return -ENOSPC;
+		}
+		entry_evict(lru);
+	}
+}
+
+static int fill_flush(void)
+{
+	int ret;
+
+	if (fill.buf_len == 0) {
+		return 0;
+	}
+
+	ret = fsu_append_abs(FILL_PATH, fill.buf, fill.buf_len);
+	fill.buf_len = 0;
+	if (ret < 0) {
+		LOG_ERR("Could not cache package [%d]", ret);
+		return ret;
+	}
+	return 0;
+}
+
+static void fill_abort(void)
+{
+	fill.active = false;
+	fill.buf_len = 0;
+	(void)fsu_delete_abs(FILL_PATH);
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_cache_lookup(const uint8_t *key)
+{
+	int ret = -ENOENT;
+	int i;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	(void)index_load();
+	for (i = 0; i < CACHE_ENTRIES; i++) {
+		if (cache_idx.entries[i].valid &&
+		    memcmp(cache_idx.entries[i].key, key, LCZ_LWM2M_SW_MGMT_CACHE_KEY_SIZE) == 0) {
+			/* Repeated hits on the most recent entry don't change the eviction order */
+			if (cache_idx.entries[i].used != cache_idx.seq) {
+				cache_idx.entries[i].used = ++cache_idx.seq;
+				(void)index_save();
+			}
+			LOG_INF("Package %s is cached", cache_idx.entries[i].version);
+			ret = i;
+			break;
+		}
+	}
+	k_mutex_unlock(&cache_lock);
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_cache_replay(int entry, uint16_t obj_inst,
+				   lcz_lwm2m_sw_mgmt_cache_out_cb_t out)
+{
+	int ret;
+	struct fs_file_t f;
+	char path[ENTRY_PATH_SIZE];
+	size_t size;
+	size_t offset;
+	size_t chunk;
+
+	if (entry < 0 || entry >= CACHE_ENTRIES) {
+		return -EINVAL;
+	}
+
+	/* The pin keeps the entry from being evicted while it is read */
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	if (!cache_idx.entries[entry].valid) {
+		k_mutex_unlock(&cache_lock);
+		return -ENOENT;
+	}
+	pins[entry]++;
+	size = cache_idx.entries[entry].size;
+	k_mutex_unlock(&cache_lock);
+
+	k_mutex_lock(&replay_lock, K_FOREVER);
+	entry_path(entry, path, sizeof(path));
+	fs_file_t_init(&f);
+	ret = fs_open(&f, path, FS_O_READ);
+	if (ret < 0) {
+		LOG_ERR("Could not open cached package [%d]", ret);
+		goto exit;
+	}
+
+	for (offset = 0; offset < size; offset += chunk) {
+		chunk = MIN(size - offset, sizeof(replay_buf));
+		ret = fs_read(&f, replay_buf, chunk);
+		if (ret >= 0 && (size_t)ret != chunk) {
+			ret = -EIO;
+		}
+		if (ret < 0) {
+			break;
+		}
+		ret = out(obj_inst, replay_buf, chunk, offset + chunk == size, size);
+		if (ret < 0) {
+			break;
+		}
+	}
+	(void)fs_close(&f);
+
+exit:
+	k_mutex_unlock(&replay_lock);
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	pins[entry]--;
+	k_mutex_unlock(&cache_lock);
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_cache_fill_start(uint16_t obj_inst, const uint8_t *key,
+				       const char *version)
+{
+	int ret = 0;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	if (fill.active && fill.obj_inst != obj_inst) {
+		ret = -EBUSY;
+		goto exit;
+	}
+
+	(void)index_load();
+	fill_abort();
+	fill.obj_inst = obj_inst;
+	memcpy(fill.key, key, sizeof(fill.key));
+	strncpy(fill.version, version, sizeof(fill.version) - 1);
+	fill.version[sizeof(fill.version) - 1] = '\0';
+	fill.size = 0;
+	fill.active = true;
+
+exit:
+	k_mutex_unlock(&cache_lock);
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_cache_fill_write(uint16_t obj_inst, const uint8_t *data, size_t data_len)
+{
+	int ret = 0;
+	size_t chunk;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	if (!fill.active || fill.obj_inst != obj_inst) {
+		goto exit;
+	}
+
+	if (fill.size + data_len > CACHE_MAX_SIZE) {
+		LOG_WRN("Package too large to cache");
+		fill_abort();
+		goto exit;
+	}
+
+	/* Batched like the file backend, so the file system sees few large appends */
+	fill.size += data_len;
+	while (data_len > 0) {
+		chunk = MIN(data_len, sizeof(fill.buf) - fill.buf_len);
+		memcpy(&fill.buf[fill.buf_len], data, chunk);
+		fill.buf_len += chunk;
+		data += chunk;
+		data_len -= chunk;
+
+		if (fill.buf_len == sizeof(fill.buf)) {
+			ret = fill_flush();
+			if (ret < 0) {
+				fill_abort();
+				break;
+			}
+		}
+	}
+
+exit:
+	k_mutex_unlock(&cache_lock);
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_cache_fill_finish(uint16_t obj_inst, bool commit)
+{
+	int ret = 0;
+	int entry;
+	char path[ENTRY_PATH_SIZE];
+	struct cache_entry *e;
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	if (!fill.active || fill.obj_inst != obj_inst) {
+		goto exit;
+	}
+
+	if (!commit || fill.size == 0) {
+		fill_abort();
+		goto exit;
+	}
+
+	ret = fill_flush();
+	if (ret < 0) {
+		fill_abort();
+		goto exit;
+	}
+
+	/* An older copy of the same package is replaced, unless it is being replayed */
+	for (entry = 0; entry < CACHE_ENTRIES; entry++) {
+		if (cache_idx.entries[entry].valid &&
+		    memcmp(cache_idx.entries[entry].key, fill.key, sizeof(fill.key)) == 0) {
+			if (pins[entry] > 0) {
+				fill_abort();
+				goto exit;
+			}
+			entry_evict(entry);
+		}
+	}
+
+	entry = entry_alloc(fill.size);
+	if (entry < 0) {
+		fill_abort();
+		ret = entry;
+		goto exit;
+	}
+
+	entry_path(entry, path, sizeof(path));
+	(void)fsu_delete_abs(path);
+	ret = fs_rename(FILL_PATH, path);
+	if (ret < 0) {
+		LOG_ERR("Could not add package to cache [%d]", ret);
+		fill_abort();
+		goto exit;
+	}
+
+	e = &cache_idx.entries[entry];
+	memcpy(e->key, fill.key, sizeof(e->key));
+	memcpy(e->version, fill.version, sizeof(e->version));
+	e->size = fill.size;
+	e->used = ++cache_idx.seq;
+	e->valid = true;
+	fill.active = false;
+	ret = index_save();
+	LOG_INF("Cached package %s (%u bytes)", e->version, e->size);
+
+exit:
+	k_mutex_unlock(&cache_lock);
+	return ret;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_cache.h
+ * @brief Package cache used by the software management download path
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_CACHE_H__
+#define __LCZ_LWM2M_SW_MGMT_CACHE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Packages are identified by the digest from their manifest */
+#define LCZ_LWM2M_SW_MGMT_CACHE_KEY_SIZE 32
+
+/**
+ * @brief Receives a cached image
+ *
+ * @param obj_inst instance of object 9 the image is replayed for
+ * @param data image data
+ * @param data_len size of data
+ * @param last_block true for the final chunk of the image
+ * @param total_size size of the image
+ * @return int 0 on success, < 0 on error
+ */
+typedef int (*lcz_lwm2m_sw_mgmt_cache_out_cb_t)(uint16_t obj_inst, uint8_t *data,
+						uint16_t data_len, bool last_block,
+						size_t total_size);
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Find a cached image. A hit makes the entry the most recently used.
+ *
+ * @param key package digest
+ * @return int entry index, -ENOENT if the package is not cached
+ */
+int lcz_lwm2m_sw_mgmt_cache_lookup(const uint8_t *key);
+
+/**
+ * @brief Pass a cached image to a backend
+ *
+ * @param entry entry index from lcz_lwm2m_sw_mgmt_cache_lookup()
+ * @param obj_inst instance of object 9
+ * @param out receives the image
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_cache_replay(int entry, uint16_t obj_inst,
+				   lcz_lwm2m_sw_mgmt_cache_out_cb_t out);
+
+/**
+ * @brief Start caching the image of a package as it is delivered to a backend.
+ * One package is cached at a time.
+ *
+ * @param obj_inst instance of object 9
+ * @param key package digest
+ * @param version package version, for the log
+ * @return int 0 on success, -EBUSY if another package is being cached, other < 0 errors
+ */
+int lcz_lwm2m_sw_mgmt_cache_fill_start(uint16_t obj_inst, const uint8_t *key,
+				       const char *version);
+
+/**
+ * @brief Add image data to the package being cached
+ *
+ * @param obj_inst instance of object 9
+ * @param data image data
+ * @param data_len size of data
+ * @return int 0 on success or if obj_inst isn't caching, < 0 on error (caching is abandoned)
+ */
+int lcz_lwm2m_sw_mgmt_cache_fill_write(uint16_t obj_inst, const uint8_t *data, size_t data_len);
+
+/**
+ * @brief Finish caching a package
+ *
+ * @param obj_inst instance of object 9
+ * @param commit true to add the image to the cache (evicting the least recently used entries
+ * if needed), false to discard it
+ * @return int 0 on success or if obj_inst isn't caching, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_cache_fill_finish(uint16_t obj_inst, bool commit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_CACHE_H__ */
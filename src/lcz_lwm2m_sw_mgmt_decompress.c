@@ -0,0 +1,228 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_decompress.c
+ * @brief Streaming heatshrink (LZSS) decompressor
+ *
+ * A compressed package is the decompressed size (u32, little endian) followed by a heatshrink
+ * stream. The stream must be encoded with the same window (-w) and lookahead (-l) sizes as
+ * CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_BITS and
+ * CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_LOOKAHEAD_BITS.
+ *
+ * Only the window and a fixed size output buffer are needed, regardless of the package size.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_decompress, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "lcz_lwm2m_sw_mgmt_decompress.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define WINDOW_BITS CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_BITS
+#define LOOKAHEAD_BITS CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_LOOKAHEAD_BITS
+#define WINDOW_MASK (LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_SIZE - 1)
+
+BUILD_ASSERT(LOOKAHEAD_BITS < WINDOW_BITS, "Lookahead must be smaller than the window");
+
+enum decompress_state {
+	DECOMPRESS_STATE_SIZE = 0,
+	DECOMPRESS_STATE_TAG,
+	DECOMPRESS_STATE_LITERAL,
+	DECOMPRESS_STATE_INDEX,
+	DECOMPRESS_STATE_COUNT,
+	DECOMPRESS_STATE_DONE,
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int flush(struct lcz_lwm2m_sw_mgmt_decompress *dec, bool last_block);
+static int output(struct lcz_lwm2m_sw_mgmt_decompress *dec, uint8_t byte);
+static uint8_t bits_needed(struct lcz_lwm2m_sw_mgmt_decompress *dec);
+static int decode(struct lcz_lwm2m_sw_mgmt_decompress *dec);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static int flush(struct lcz_lwm2m_sw_mgmt_decompress *dec, bool last_block)
+{
+	int ret;
+
+	ret = dec->out(dec->obj_inst, dec->out_buf, dec->out_len, last_block, dec->target_size);
+	dec->produced += dec->out_len;
+	dec->out_len = 0;
+	return ret;
+}
+
+static int output(struct lcz_lwm2m_sw_mgmt_decompress *dec, uint8_t byte)
+{
+	int ret;
+
+	if (dec->produced + dec->out_len >= dec->target_size) {
+		return -EBADMSG;
+	}
+
+	dec->window[dec->head & WINDOW_MASK] = byte;
+	dec->head++;
+
+	/* Flush lazily so the final chunk is always delivered with last_block set */
+	if (dec->out_len == sizeof(dec->out_buf)) {
+		ret = flush(dec, false);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	dec->out_buf[dec->out_len++] = byte;
+
+	if (dec->produced + dec->out_len == dec->target_size) {
+		dec->state = DECOMPRESS_STATE_DONE;
+		return flush(dec, true);
+	}
+	return 0;
+}
+
+static uint8_t bits_needed(struct lcz_lwm2m_sw_mgmt_decompress *dec)
+{
+	switch (dec->state) {
+	case DECOMPRESS_STATE_TAG:
+		return 1;
+	case DECOMPRESS_STATE_LITERAL:
+		return 8;
+	case DECOMPRESS_STATE_INDEX:
+		return WINDOW_BITS;
+	case DECOMPRESS_STATE_COUNT:
+		return LOOKAHEAD_BITS;
+	default:
+		return 0;
+	}
+}
+
+/* Consume as many buffered bits as possible */
+static int decode(struct lcz_lwm2m_sw_mgmt_decompress *dec)
+{
+	int ret = 0;
+	uint8_t n;
+	uint16_t value;
+	uint16_t count;
+	uint16_t offset;
+
+	n = bits_needed(dec);
+	while (ret == 0 && n > 0 && dec->bit_count >= n) {
+		dec->bit_count -= n;
+		value = (dec->bits >> dec->bit_count) & ((1 << n) - 1);
+
+		switch (dec->state) {
+		case DECOMPRESS_STATE_TAG:
+			dec->state = value ? DECOMPRESS_STATE_LITERAL : DECOMPRESS_STATE_INDEX;
+			break;
+		case DECOMPRESS_STATE_LITERAL:
+			dec->state = DECOMPRESS_STATE_TAG;
+			ret = output(dec, (uint8_t)value);
+			break;
+		case DECOMPRESS_STATE_INDEX:
+			dec->index = value;
+			dec->state = DECOMPRESS_STATE_COUNT;
+			break;
+		case DECOMPRESS_STATE_COUNT:
+			dec->state = DECOMPRESS_STATE_TAG;
+			offset = dec->index + 1;
+			for (count = value + 1; count > 0 && ret == 0; count--) {
+				ret = output(dec, dec->window[(dec->head - offset) & WINDOW_MASK]);
+				if (ret == 0 && dec->state == DECOMPRESS_STATE_DONE && count > 1) {
+					ret = -EBADMSG;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+		n = bits_needed(dec);
+	}
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_decompress_start(struct lcz_lwm2m_sw_mgmt_decompress *dec,
+				       uint16_t obj_inst, lcz_lwm2m_sw_mgmt_decompress_out_cb_t out)
+{
+	if (out == NULL) {
+		return -EINVAL;
+	}
+
+	dec->obj_inst = obj_inst;
+	dec->out = out;
+	dec->state = DECOMPRESS_STATE_SIZE;
+	dec->size_len = 0;
+	dec->target_size = 0;
+	dec->bits = 0;
+	dec->bit_count = 0;
+	dec->head = 0;
+	dec->produced = 0;
+	dec->out_len = 0;
+	/* Back-references before the start of the data read zeros, as in the heatshrink encoder */
+	memset(dec->window, 0, sizeof(dec->window));
+	dec->active = true;
+	return 0;
+}
+
+int lcz_lwm2m_sw_mgmt_decompress_write(struct lcz_lwm2m_sw_mgmt_decompress *dec,
+				       const uint8_t *data, size_t data_len, bool last_block)
+{
+	int ret = 0;
+
+	if (!dec->active) {
+		return -EINVAL;
+	}
+
+	while (data_len > 0 && ret == 0) {
+		if (dec->state == DECOMPRESS_STATE_SIZE) {
+			dec->size_buf[dec->size_len++] = *data;
+			if (dec->size_len == sizeof(dec->size_buf)) {
+				dec->target_size = sys_get_le32(dec->size_buf);
+				dec->state = DECOMPRESS_STATE_TAG;
+				if (dec->target_size == 0) {
+					dec->state = DECOMPRESS_STATE_DONE;
+					ret = flush(dec, true);
+				}
+			}
+		} else if (dec->state == DECOMPRESS_STATE_DONE) {
+			/* Only the rest of the final byte, already consumed, may be padding */
+			LOG_ERR("Data after the end of the compressed package");
+			ret = -EBADMSG;
+			break;
+		} else {
+			dec->bits = (dec->bits << 8) | *data;
+			dec->bit_count += 8;
+			ret = decode(dec);
+		}
+		data++;
+		data_len--;
+	}
+
+	if (ret == 0 && last_block && dec->state != DECOMPRESS_STATE_DONE) {
+		LOG_ERR("Compressed package truncated");
+		ret = -EBADMSG;
+	}
+
+	if (ret < 0 || last_block) {
+		dec->active = false;
+	}
+	return ret;
+}
+
+void lcz_lwm2m_sw_mgmt_decompress_abort(struct lcz_lwm2m_sw_mgmt_decompress *dec)
+{
+	dec->active = false;
+}
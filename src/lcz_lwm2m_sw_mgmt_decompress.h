@@ -0,0 +1,101 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_decompress.h
+ * @brief Streaming decompression stage used by the software management download path
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_DECOMPRESS_H__
+#define __LCZ_LWM2M_SW_MGMT_DECOMPRESS_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+#define LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_SIZE                                                   \
+	(1 << CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_BITS)
+
+/**
+ * @brief Receives decompressed data
+ *
+ * @param obj_inst instance of object 9 the package is decompressed for
+ * @param data decompressed data
+ * @param data_len size of data
+ * @param last_block true for the final chunk of decompressed data
+ * @param total_size decompressed size of the package
+ * @return int 0 on success, < 0 on error
+ */
+typedef int (*lcz_lwm2m_sw_mgmt_decompress_out_cb_t)(uint16_t obj_inst, uint8_t *data,
+						     uint16_t data_len, bool last_block,
+						     size_t total_size);
+
+struct lcz_lwm2m_sw_mgmt_decompress {
+	uint16_t obj_inst;
+	bool active;
+	lcz_lwm2m_sw_mgmt_decompress_out_cb_t out;
+	uint8_t state;
+	uint8_t size_len;
+	uint8_t size_buf[sizeof(uint32_t)];
+	uint32_t target_size;
+	uint32_t bits;
+	uint8_t bit_count;
+	uint16_t index;
+	uint16_t head;
+	size_t produced;
+	size_t out_len;
+	uint8_t window[LCZ_LWM2M_SW_MGMT_DECOMPRESS_WINDOW_SIZE];
+	uint8_t out_buf[CONFIG_LCZ_LWM2M_SW_MGMT_DECOMPRESS_BUF_SIZE];
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Start decompressing a package
+ *
+ * @param dec decompressor context
+ * @param obj_inst instance of object 9
+ * @param out receives the decompressed data
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_decompress_start(struct lcz_lwm2m_sw_mgmt_decompress *dec,
+				       uint16_t obj_inst, lcz_lwm2m_sw_mgmt_decompress_out_cb_t out);
+
+/**
+ * @brief Feed the next block of the compressed package to the decompressor
+ *
+ * @param dec decompressor context
+ * @param data compressed data
+ * @param data_len size of data
+ * @param last_block true for the last block of the package
+ * @return int 0 on success, -EBADMSG if the stream is malformed, truncated or followed by more
+ * data than the padding of its final byte, other < 0 errors from the output callback
+ */
+int lcz_lwm2m_sw_mgmt_decompress_write(struct lcz_lwm2m_sw_mgmt_decompress *dec,
+				       const uint8_t *data, size_t data_len, bool last_block);
+
+/**
+ * @brief Abandon decompression in progress
+ *
+ * @param dec decompressor context
+ */
+void lcz_lwm2m_sw_mgmt_decompress_abort(struct lcz_lwm2m_sw_mgmt_decompress *dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_DECOMPRESS_H__ */
@@ -0,0 +1,296 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_delta.c
+ * @brief Streaming delta patch decoder
+ *
+ * Patch format (all integers little endian):
+ *
+ *   header:  "LCZD" | target_size (u32) | base_len (u8) | base_version (base_len bytes)
+ *   command: 0x00                                   end of patch
+ *            0x01 | offset (u32) | length (u32)     copy length bytes of the installed image
+ *                                                   starting at offset
+ *            0x02 | length (u32) | data             insert length literal bytes
+ *
+ * The image is rebuilt in a fixed size output buffer, so RAM use does not depend on the size of
+ * the patch or the image.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_delta, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "lcz_lwm2m_sw_mgmt_delta.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define DELTA_MAGIC "LCZD"
+#define DELTA_MAGIC_SIZE (sizeof(DELTA_MAGIC) - 1)
+#define DELTA_HEADER_SIZE (DELTA_MAGIC_SIZE + sizeof(uint32_t) + sizeof(uint8_t))
+
+#define DELTA_OP_END 0x00
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_INSERT 0x02
+
+enum delta_state {
+	DELTA_STATE_HEADER = 0,
+	DELTA_STATE_BASE_VERSION,
+	DELTA_STATE_COMMAND,
+	DELTA_STATE_ARGS,
+	DELTA_STATE_INSERT,
+	DELTA_STATE_DONE,
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static void expect(struct lcz_lwm2m_sw_mgmt_delta *delta, enum delta_state state, size_t need);
+static bool collect(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t **data, size_t *data_len);
+static int flush(struct lcz_lwm2m_sw_mgmt_delta *delta, bool last_block);
+static int emit(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t *data, size_t len);
+static int copy(struct lcz_lwm2m_sw_mgmt_delta *delta);
+static int process(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t **data, size_t *data_len);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void expect(struct lcz_lwm2m_sw_mgmt_delta *delta, enum delta_state state, size_t need)
+{
+	delta->state = state;
+	delta->need = need;
+	delta->scratch_len = 0;
+}
+
+/* Gather a fixed size field that may be split across blocks */
+static bool collect(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t **data, size_t *data_len)
+{
+	size_t n = MIN(delta->need - delta->scratch_len, *data_len);
+
+	memcpy(&delta->scratch[delta->scratch_len], *data, n);
+	delta->scratch_len += n;
+	*data += n;
+	*data_len -= n;
+
+	return delta->scratch_len == delta->need;
+}
+
+static int flush(struct lcz_lwm2m_sw_mgmt_delta *delta, bool last_block)
+{
+	int ret;
+
+	ret = delta->out(delta->obj_inst, delta->out_buf, delta->out_len, last_block,
+			 delta->target_size);
+	delta->produced += delta->out_len;
+	delta->out_len = 0;
+	return ret;
+}
+
+static int emit(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t *data, size_t len)
+{
+	int ret;
+	size_t n;
+
+	if (delta->produced + delta->out_len + len > delta->target_size) {
+		return -EBADMSG;
+	}
+
+	while (len > 0) {
+		/* Flush lazily so the final chunk is always delivered with last_block set */
+		if (delta->out_len == sizeof(delta->out_buf)) {
+			ret = flush(delta, false);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		n = MIN(len, sizeof(delta->out_buf) - delta->out_len);
+		memcpy(&delta->out_buf[delta->out_len], data, n);
+		delta->out_len += n;
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int copy(struct lcz_lwm2m_sw_mgmt_delta *delta)
+{
+	int ret;
+	size_t n;
+
+	if (delta->produced + delta->out_len + delta->remaining > delta->target_size) {
+		return -EBADMSG;
+	}
+
+	while (delta->remaining > 0) {
+		if (delta->out_len == sizeof(delta->out_buf)) {
+			ret = flush(delta, false);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		n = MIN(delta->remaining, sizeof(delta->out_buf) - delta->out_len);
+		ret = delta->source_read(delta->copy_offset, &delta->out_buf[delta->out_len], n);
+		if (ret < 0) {
+			LOG_ERR("Source read at %u [%d]", delta->copy_offset, ret);
+			return ret;
+		}
+		delta->out_len += n;
+		delta->copy_offset += n;
+		delta->remaining -= n;
+	}
+	return 0;
+}
+
+static int process(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t **data, size_t *data_len)
+{
+	int ret = 0;
+	size_t n;
+
+	switch (delta->state) {
+	case DELTA_STATE_HEADER:
+		if (collect(delta, data, data_len)) {
+			if (memcmp(delta->scratch, DELTA_MAGIC, DELTA_MAGIC_SIZE) != 0) {
+				return -EBADMSG;
+			}
+			delta->target_size = sys_get_le32(&delta->scratch[DELTA_MAGIC_SIZE]);
+			n = delta->scratch[DELTA_HEADER_SIZE - 1];
+			if (n > sizeof(delta->scratch)) {
+				return -EBADMSG;
+			}
+			if (n == 0) {
+				expect(delta, DELTA_STATE_COMMAND, 1);
+			} else {
+				expect(delta, DELTA_STATE_BASE_VERSION, n);
+			}
+		}
+		break;
+	case DELTA_STATE_BASE_VERSION:
+		if (collect(delta, data, data_len)) {
+			if (delta->base_version == NULL ||
+			    strlen(delta->base_version) != delta->need ||
+			    memcmp(delta->scratch, delta->base_version, delta->need) != 0) {
+				LOG_ERR("Patch is for a different base version");
+				return -ECANCELED;
+			}
+			expect(delta, DELTA_STATE_COMMAND, 1);
+		}
+		break;
+	case DELTA_STATE_COMMAND:
+		if (collect(delta, data, data_len)) {
+			delta->op = delta->scratch[0];
+			if (delta->op == DELTA_OP_END) {
+				if (delta->produced + delta->out_len != delta->target_size) {
+					return -EBADMSG;
+				}
+				ret = flush(delta, true);
+				expect(delta, DELTA_STATE_DONE, 0);
+			} else if (delta->op == DELTA_OP_COPY) {
+				expect(delta, DELTA_STATE_ARGS, 2 * sizeof(uint32_t));
+			} else if (delta->op == DELTA_OP_INSERT) {
+				expect(delta, DELTA_STATE_ARGS, sizeof(uint32_t));
+			} else {
+				return -EBADMSG;
+			}
+		}
+		break;
+	case DELTA_STATE_ARGS:
+		if (collect(delta, data, data_len)) {
+			if (delta->op == DELTA_OP_COPY) {
+				delta->copy_offset = sys_get_le32(&delta->scratch[0]);
+				delta->remaining = sys_get_le32(&delta->scratch[sizeof(uint32_t)]);
+				ret = copy(delta);
+				expect(delta, DELTA_STATE_COMMAND, 1);
+			} else {
+				delta->remaining = sys_get_le32(&delta->scratch[0]);
+				if (delta->remaining > 0) {
+					expect(delta, DELTA_STATE_INSERT, 0);
+				} else {
+					expect(delta, DELTA_STATE_COMMAND, 1);
+				}
+			}
+		}
+		break;
+	case DELTA_STATE_INSERT:
+		n = MIN(delta->remaining, *data_len);
+		ret = emit(delta, *data, n);
+		*data += n;
+		*data_len -= n;
+		delta->remaining -= n;
+		if (delta->remaining == 0) {
+			expect(delta, DELTA_STATE_COMMAND, 1);
+		}
+		break;
+	case DELTA_STATE_DONE:
+	default:
+		/* Nothing is allowed after the end of the patch */
+		return -EBADMSG;
+	}
+
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+bool lcz_lwm2m_sw_mgmt_delta_is_patch(const uint8_t *data, size_t data_len)
+{
+	return data_len >= DELTA_MAGIC_SIZE && memcmp(data, DELTA_MAGIC, DELTA_MAGIC_SIZE) == 0;
+}
+
+int lcz_lwm2m_sw_mgmt_delta_start(struct lcz_lwm2m_sw_mgmt_delta *delta, uint16_t obj_inst,
+				  const char *base_version,
+				  lcz_lwm2m_sw_mgmt_source_read_cb_t source_read,
+				  lcz_lwm2m_sw_mgmt_delta_out_cb_t out)
+{
+	if (source_read == NULL || out == NULL) {
+		return -ENOTSUP;
+	}
+
+	delta->obj_inst = obj_inst;
+	delta->base_version = base_version;
+	delta->source_read = source_read;
+	delta->out = out;
+	delta->target_size = 0;
+	delta->produced = 0;
+	delta->out_len = 0;
+	delta->remaining = 0;
+	expect(delta, DELTA_STATE_HEADER, DELTA_HEADER_SIZE);
+	delta->active = true;
+	return 0;
+}
+
+int lcz_lwm2m_sw_mgmt_delta_write(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t *data,
+				  size_t data_len, bool last_block)
+{
+	int ret = 0;
+
+	if (!delta->active) {
+		return -EINVAL;
+	}
+
+	while (data_len > 0 && ret == 0) {
+		ret = process(delta, &data, &data_len);
+	}
+
+	if (ret == 0 && last_block && delta->state != DELTA_STATE_DONE) {
+		LOG_ERR("Patch truncated");
+		ret = -EBADMSG;
+	}
+
+	if (ret < 0 || last_block) {
+		delta->active = false;
+	}
+	return ret;
+}
+
+void lcz_lwm2m_sw_mgmt_delta_abort(struct lcz_lwm2m_sw_mgmt_delta *delta)
+{
+	delta->active = false;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_delta.h
+ * @brief Streaming delta patch decoder used by the software management download path
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_DELTA_H__
+#define __LCZ_LWM2M_SW_MGMT_DELTA_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Largest fixed size field the decoder has to collect across blocks (the base version string) */
+#define LCZ_LWM2M_SW_MGMT_DELTA_SCRATCH_SIZE 32
+
+/**
+ * @brief Receives reconstructed image data
+ *
+ * @param obj_inst instance of object 9 the patch is applied for
+ * @param data image data
+ * @param data_len size of data
+ * @param last_block true for the final chunk of the image
+ * @param total_size size of the reconstructed image
+ * @return int 0 on success, < 0 on error
+ */
+typedef int (*lcz_lwm2m_sw_mgmt_delta_out_cb_t)(uint16_t obj_inst, uint8_t *data,
+						uint16_t data_len, bool last_block,
+						size_t total_size);
+
+struct lcz_lwm2m_sw_mgmt_delta {
+	uint16_t obj_inst;
+	bool active;
+	lcz_lwm2m_sw_mgmt_source_read_cb_t source_read;
+	lcz_lwm2m_sw_mgmt_delta_out_cb_t out;
+	const char *base_version;
+	uint8_t state;
+	uint8_t op;
+	uint8_t scratch[LCZ_LWM2M_SW_MGMT_DELTA_SCRATCH_SIZE];
+	size_t scratch_len;
+	size_t need;
+	uint32_t target_size;
+	uint32_t copy_offset;
+	uint32_t remaining;
+	size_t produced;
+	size_t out_len;
+	uint8_t out_buf[CONFIG_LCZ_LWM2M_SW_MGMT_DELTA_BUF_SIZE];
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Check if the first block of a package is a delta patch
+ *
+ * @param data first block of the package
+ * @param data_len size of data
+ * @return true if the package starts with the delta patch magic
+ */
+bool lcz_lwm2m_sw_mgmt_delta_is_patch(const uint8_t *data, size_t data_len);
+
+/**
+ * @brief Start applying a delta patch
+ *
+ * @param delta decoder context
+ * @param obj_inst instance of object 9
+ * @param base_version version currently installed, must match the patch base version
+ * @param source_read reads the currently installed image
+ * @param out receives the reconstructed image
+ * @return int 0 on success, < 0 on error
+ */
+int lcz_lwm2m_sw_mgmt_delta_start(struct lcz_lwm2m_sw_mgmt_delta *delta, uint16_t obj_inst,
+				  const char *base_version,
+				  lcz_lwm2m_sw_mgmt_source_read_cb_t source_read,
+				  lcz_lwm2m_sw_mgmt_delta_out_cb_t out);
+
+/**
+ * @brief Feed the next block of the patch to the decoder
+ *
+ * @param delta decoder context
+ * @param data patch data
+ * @param data_len size of data
+ * @param last_block true for the last block of the patch
+ * @return int 0 on success, -ECANCELED if the patch is for a different base version,
+ * -EBADMSG if the patch is malformed, other < 0 errors from the source or output callbacks
+ */
+int lcz_lwm2m_sw_mgmt_delta_write(struct lcz_lwm2m_sw_mgmt_delta *delta, const uint8_t *data,
+				  size_t data_len, bool last_block);
+
+/**
+ * @brief Abandon a delta patch in progress
+ *
+ * @param delta decoder context
+ */
+void lcz_lwm2m_sw_mgmt_delta_abort(struct lcz_lwm2m_sw_mgmt_delta *delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_DELTA_H__ */
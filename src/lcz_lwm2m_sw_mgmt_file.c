@@ -0,0 +1,811 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_file.c
+ * @brief File staging backend for LwM2M software management.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_file, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/fs/fs.h>
+#include <file_system_utilities.h>
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME) || defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+#include <zephyr/sys/crc.h>
+#endif
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#include "lcz_lwm2m_sw_mgmt_file.h"
+#include "lcz_lwm2m_sw_mgmt_fs.h"
+#include "lcz_lwm2m_sw_mgmt_trace.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_PATH CONFIG_LCZ_LWM2M_SW_MGMT_FILE_MAX_PATH
+
+#define STAGING_BUF_SIZE CONFIG_LCZ_LWM2M_SW_MGMT_FILE_STAGING_BUF_SIZE
+#define STAGING_BUF_ALIGN CONFIG_LCZ_LWM2M_SW_MGMT_FILE_STAGING_BUF_ALIGN
+#define SPACE_MARGIN CONFIG_LCZ_LWM2M_SW_MGMT_FILE_SPACE_MARGIN
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+#define CHECKPOINT_SUFFIX ".ckpt"
+#define CHECKPOINT_MAGIC 0x534d4350 /* "SMCP" */
+#define CHECKPOINT_INTERVAL CONFIG_LCZ_LWM2M_SW_MGMT_FILE_CHECKPOINT_INTERVAL
+
+struct checkpoint {
+	uint32_t magic;
+	uint32_t total_size;
+	uint32_t committed;
+	/* From lcz_lwm2m_sw_mgmt_package_id(), with the size it identifies the package */
+	uint32_t id_crc;
+	/* CRC of the fields above */
+	uint32_t crc;
+};
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+#define SLOT_COUNT 2
+#define SLOTS_SUFFIX ".slots"
+#define SLOTS_MAGIC 0x534d4142 /* "SMAB" */
+
+/* Persisted next to the slot files */
+struct slots {
+	uint32_t magic;
+	uint32_t size[SLOT_COUNT];
+	uint8_t state[SLOT_COUNT];
+	/* Slot the current (or next) download is written to */
+	uint8_t write_slot;
+	/* Slot holding the package the next install uses */
+	uint8_t install_slot;
+	/* CRC of the fields above */
+	uint32_t crc;
+};
+#endif
+
+struct staging {
+	/* Number of bytes currently held in the staging buffer */
+	size_t len;
+	/* Bytes of the staging buffer used for the current download */
+	size_t limit;
+	/* Number of file system writes performed for the current download */
+	uint32_t flushes;
+	/* Number of download blocks received for the current download */
+	uint32_t blocks;
+	/* Number of bytes written to the staging file */
+	size_t committed;
+};
+
+struct lcz_lwm2m_sw_mgmt_file {
+	bool in_use;
+	uint16_t obj_inst;
+	char path[MAX_PATH];
+	size_t bytes_downloaded;
+	size_t file_size;
+	bool downloaded;
+	/* Last progress percentage logged */
+	int download_pct;
+	struct staging staging;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	char checkpoint_path[MAX_PATH];
+	struct checkpoint checkpoint;
+	bool checkpoint_valid;
+	/* Bytes of the current download that are already in the staging file */
+	size_t resume_offset;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	/* path is a copy of the write slot path */
+	char slot_path[SLOT_COUNT][MAX_PATH];
+	char slots_path[MAX_PATH];
+	struct slots slots;
+#endif
+	uint8_t buf[STAGING_BUF_SIZE] __aligned(STAGING_BUF_ALIGN);
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int staging_flush(struct lcz_lwm2m_sw_mgmt_file *file);
+static void staging_reset(struct lcz_lwm2m_sw_mgmt_file *file);
+static int staging_write(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t *data, size_t len);
+static int start_download(struct lcz_lwm2m_sw_mgmt_file *file, size_t total_size);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+static uint32_t checkpoint_crc(struct checkpoint *checkpoint);
+static bool checkpoint_due(struct lcz_lwm2m_sw_mgmt_file *file);
+static int checkpoint_save(struct lcz_lwm2m_sw_mgmt_file *file);
+static int checkpoint_load(struct lcz_lwm2m_sw_mgmt_file *file);
+static int truncate_file(const char *path, size_t len);
+#endif
+static int set_paths(struct lcz_lwm2m_sw_mgmt_file *file, const char *file_name);
+static int delete_files(struct lcz_lwm2m_sw_mgmt_file *file);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+static uint32_t slots_crc(struct slots *slots);
+static int slots_save(struct lcz_lwm2m_sw_mgmt_file *file);
+static void slots_load(struct lcz_lwm2m_sw_mgmt_file *file);
+static void slot_select(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot);
+static int slot_start(struct lcz_lwm2m_sw_mgmt_file *file);
+#endif
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct lcz_lwm2m_sw_mgmt_file file_pool[CONFIG_LCZ_LWM2M_SW_MGMT_FILE_COUNT];
+static K_MUTEX_DEFINE(file_pool_lock);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+static const char *const slot_suffix[SLOT_COUNT] = { ".a", ".b" };
+#endif
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+static uint32_t checkpoint_crc(struct checkpoint *checkpoint)
+{
+	return crc32_ieee((uint8_t *)checkpoint, offsetof(struct checkpoint, crc));
+}
+
+static bool checkpoint_due(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	if (file->checkpoint.magic != CHECKPOINT_MAGIC) {
+		return false;
+	}
+	return (file->staging.flushes % CHECKPOINT_INTERVAL) == 0 ||
+	       file->staging.committed == file->checkpoint.total_size;
+}
+
+static int checkpoint_save(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+
+	file->checkpoint.committed = file->staging.committed;
+	file->checkpoint.crc = checkpoint_crc(&file->checkpoint);
+	ret = fsu_write_abs(file->checkpoint_path, &file->checkpoint, sizeof(file->checkpoint));
+	if (ret < 0) {
+		LOG_ERR("Could not save checkpoint [%d]", ret);
+		file->checkpoint_valid = false;
+	} else {
+		file->checkpoint_valid = true;
+		ret = 0;
+	}
+	return ret;
+}
+
+static int checkpoint_load(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+	struct checkpoint *checkpoint = &file->checkpoint;
+
+	file->checkpoint_valid = false;
+	ret = fsu_read_abs(file->checkpoint_path, checkpoint, sizeof(*checkpoint));
+	if (ret != sizeof(*checkpoint)) {
+		return -ENOENT;
+	}
+
+	if (checkpoint->magic != CHECKPOINT_MAGIC || checkpoint->crc != checkpoint_crc(checkpoint) ||
+	    checkpoint->committed > checkpoint->total_size) {
+		return -EINVAL;
+	}
+
+	/* Data appended after the last checkpoint can't be trusted, the download resumes from the
+	 * checkpoint.
+	 */
+	ret = fsu_get_file_size_abs(file->path);
+	if (ret < 0 || (uint32_t)ret < checkpoint->committed) {
+		return -EINVAL;
+	}
+	if ((uint32_t)ret > checkpoint->committed) {
+		ret = truncate_file(file->path, checkpoint->committed);
+		if (ret < 0) {
+			LOG_ERR("Could not truncate partial download [%d]", ret);
+			return ret;
+		}
+	}
+
+	file->checkpoint_valid = true;
+	LOG_INF("Partial download found %u/%u", checkpoint->committed, checkpoint->total_size);
+	return 0;
+}
+
+static int truncate_file(const char *path, size_t len)
+{
+	int ret;
+	struct fs_file_t f;
+
+	fs_file_t_init(&f);
+	ret = fs_open(&f, path, FS_O_RDWR);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = fs_truncate(&f, len);
+	(void)fs_close(&f);
+	return ret;
+}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+static uint32_t slots_crc(struct slots *slots)
+{
+	return crc32_ieee((uint8_t *)slots, offsetof(struct slots, crc));
+}
+
+static int slots_save(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+
+	file->slots.crc = slots_crc(&file->slots);
+	ret = fsu_write_abs(file->slots_path, &file->slots, sizeof(file->slots));
+	if (ret < 0) {
+		LOG_ERR("Could not save slot state [%d]", ret);
+		return ret;
+	}
+	return 0;
+}
+
+static void slots_load(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+	int i;
+	struct slots *slots = &file->slots;
+
+	ret = fsu_read_abs(file->slots_path, slots, sizeof(*slots));
+	if (ret != sizeof(*slots) || slots->magic != SLOTS_MAGIC || slots->crc != slots_crc(slots) ||
+	    slots->write_slot >= SLOT_COUNT || slots->install_slot >= SLOT_COUNT) {
+		memset(slots, 0, sizeof(*slots));
+		slots->magic = SLOTS_MAGIC;
+	}
+
+	for (i = 0; i < SLOT_COUNT; i++) {
+		if (slots->state[i] == LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING) {
+			/* The install was interrupted, the package can be installed again */
+			slots->state[i] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED;
+		}
+		if (slots->state[i] >= LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED) {
+			ret = fsu_get_file_size_abs(file->slot_path[i]);
+			if (ret < 0 || (uint32_t)ret != slots->size[i]) {
+				LOG_WRN("Slot %d lost its package", i);
+				slots->state[i] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_EMPTY;
+			}
+		}
+	}
+
+	slot_select(file, slots->write_slot);
+	file->downloaded =
+		slots->state[slots->install_slot] == LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED;
+	file->file_size = file->downloaded ? slots->size[slots->install_slot] : 0;
+	(void)slots_save(file);
+}
+
+static void slot_select(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot)
+{
+	file->slots.write_slot = slot;
+	strcpy(file->path, file->slot_path[slot]);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	snprintk(file->checkpoint_path, sizeof(file->checkpoint_path), "%s%s", file->path,
+		 CHECKPOINT_SUFFIX);
+#endif
+}
+
+/* Write the new package to the slot that costs the least: an unused slot, then one holding a
+ * package that was never installed, then the last good image. The slot being installed is never
+ * overwritten.
+ */
+static int slot_start(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	static const uint8_t cost[] = {
+		[LCZ_LWM2M_SW_MGMT_FILE_SLOT_EMPTY] = 0,
+		[LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADING] = 0,
+		[LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED] = 1,
+		[LCZ_LWM2M_SW_MGMT_FILE_SLOT_GOOD] = 2,
+		[LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING] = 3,
+	};
+	struct slots *slots = &file->slots;
+	uint8_t slot = slots->write_slot;
+	uint8_t other = (slot + 1) % SLOT_COUNT;
+
+	if (cost[slots->state[other]] < cost[slots->state[slot]]) {
+		slot = other;
+		slot_select(file, slot);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+		(void)checkpoint_load(file);
+#endif
+	}
+
+	if (slots->state[slot] == LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING) {
+		LOG_ERR("Both slots are busy");
+		return -EBUSY;
+	}
+
+	LOG_INF("[%d] Downloading to slot %c", file->obj_inst, 'a' + slot);
+	slots->state[slot] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADING;
+	slots->size[slot] = 0;
+	return slots_save(file);
+}
+#endif
+
+static int set_paths(struct lcz_lwm2m_sw_mgmt_file *file, const char *file_name)
+{
+	int len;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	int i;
+
+	len = snprintk(file->slots_path, sizeof(file->slots_path), "%s/%s%s",
+		       CONFIG_FSU_MOUNT_POINT, file_name, SLOTS_SUFFIX);
+	for (i = 0; i < SLOT_COUNT && len > 0 && len < MAX_PATH; i++) {
+		len = snprintk(file->slot_path[i], sizeof(file->slot_path[i]), "%s/%s%s",
+			       CONFIG_FSU_MOUNT_POINT, file_name, slot_suffix[i]);
+	}
+	if (len > 0 && len < MAX_PATH) {
+		strcpy(file->path, file->slot_path[0]);
+	}
+#else
+	len = snprintk(file->path, sizeof(file->path), "%s/%s", CONFIG_FSU_MOUNT_POINT,
+		       file_name);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	if (len > 0 && len < MAX_PATH) {
+		len = snprintk(file->checkpoint_path, sizeof(file->checkpoint_path), "%s%s",
+			       file->path, CHECKPOINT_SUFFIX);
+	}
+#endif
+	return (len <= 0 || len >= MAX_PATH) ? -ENAMETOOLONG : 0;
+}
+
+/* Remove the write slot file and its checkpoint without touching the download state */
+static int delete_files(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	file->checkpoint_valid = false;
+	file->resume_offset = 0;
+	if (fsu_get_file_size_abs(file->checkpoint_path) > 0) {
+		(void)fsu_delete_abs(file->checkpoint_path);
+	}
+#endif
+
+	ret = fsu_get_file_size_abs(file->path);
+	if (ret > 0) {
+		ret = fsu_delete_abs(file->path);
+	} else {
+		ret = 0;
+	}
+	return ret;
+}
+
+static int start_download(struct lcz_lwm2m_sw_mgmt_file *file, size_t total_size)
+{
+	int ret;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	uint32_t id_crc = 0;
+	bool identified;
+	struct checkpoint *checkpoint = &file->checkpoint;
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	ret = slot_start(file);
+	if (ret < 0) {
+		return ret;
+	}
+#endif
+
+	file->downloaded = false;
+	file->download_pct = 0;
+	staging_reset(file);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	/* A package that can't be identified is neither resumed nor checkpointed */
+	identified = (lcz_lwm2m_sw_mgmt_package_id(file->obj_inst, &id_crc) == 0);
+	if (identified && file->checkpoint_valid && checkpoint->total_size == total_size &&
+	    checkpoint->id_crc == id_crc) {
+		file->staging.committed = checkpoint->committed;
+		file->resume_offset = checkpoint->committed;
+		LOG_INF("Resuming download at %zu", file->resume_offset);
+		return lcz_lwm2m_sw_mgmt_fs_reserve(
+			total_size - checkpoint->committed + SPACE_MARGIN, NULL);
+	}
+#endif
+
+	ret = delete_files(file);
+	if (ret < 0) {
+		LOG_ERR("Could not delete file [%d]", ret);
+		return ret;
+	}
+
+	/* Reject a package that can't fit before any of it is written */
+	ret = lcz_lwm2m_sw_mgmt_fs_reserve(total_size + SPACE_MARGIN, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	checkpoint->magic = identified ? CHECKPOINT_MAGIC : 0;
+	checkpoint->total_size = total_size;
+	checkpoint->committed = 0;
+	checkpoint->id_crc = id_crc;
+#endif
+	return 0;
+}
+
+static int staging_flush(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret = 0;
+	uint32_t start;
+
+	if (file->staging.len > 0) {
+		SW_MGMT_TRACE_WRITE_START(file->obj_inst, file->staging.len);
+		start = k_cycle_get_32();
+		ret = fsu_append_abs(file->path, file->buf, file->staging.len);
+		lcz_lwm2m_sw_mgmt_stats_storage_write(
+			file->obj_inst, k_cyc_to_us_floor32(k_cycle_get_32() - start), ret);
+		SW_MGMT_TRACE_WRITE_END(file->obj_inst, ret);
+		file->staging.len = 0;
+		if (ret < 0) {
+			LOG_ERR("Could not write file [%d]", ret);
+		} else {
+			file->staging.committed += ret;
+			file->staging.flushes++;
+			ret = 0;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+			/* A reset loses at most the flushes since the last checkpoint */
+			if (checkpoint_due(file)) {
+				ret = checkpoint_save(file);
+			}
+#endif
+		}
+	}
+	return ret;
+}
+
+static void staging_reset(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	file->staging.len = 0;
+	file->staging.limit = MIN(lcz_lwm2m_sw_mgmt_params()->staging_buf_size, sizeof(file->buf));
+	file->staging.flushes = 0;
+	file->staging.blocks = 0;
+	file->staging.committed = 0;
+}
+
+static int staging_write(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t *data, size_t len)
+{
+	int ret = 0;
+	size_t chunk;
+
+	file->staging.blocks++;
+	while (len > 0) {
+		chunk = MIN(len, file->staging.limit - file->staging.len);
+		memcpy(&file->buf[file->staging.len], data, chunk);
+		file->staging.len += chunk;
+		data += chunk;
+		len -= chunk;
+
+		if (file->staging.len == file->staging.limit) {
+			ret = staging_flush(file);
+			if (ret < 0) {
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+struct lcz_lwm2m_sw_mgmt_file *lcz_lwm2m_sw_mgmt_file_open(uint16_t obj_inst,
+							    const char *file_name)
+{
+	struct lcz_lwm2m_sw_mgmt_file *file = NULL;
+	int i;
+
+	k_mutex_lock(&file_pool_lock, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(file_pool); i++) {
+		if (!file_pool[i].in_use) {
+			file = &file_pool[i];
+			file->in_use = true;
+			break;
+		}
+	}
+	k_mutex_unlock(&file_pool_lock);
+
+	if (file == NULL) {
+		LOG_ERR("No free staging file for instance %d", obj_inst);
+		return NULL;
+	}
+
+	file->obj_inst = obj_inst;
+	file->bytes_downloaded = 0;
+	file->file_size = 0;
+	file->downloaded = false;
+	staging_reset(file);
+
+	if (set_paths(file, file_name) < 0) {
+		LOG_ERR("Staging file path too long");
+		file->in_use = false;
+		return NULL;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	/* Complete packages survive a reboot, only a partial download may be discarded */
+	slots_load(file);
+	if (file->slots.state[file->slots.write_slot] != LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADING) {
+		return file;
+	}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	/* Keep a partial download that can be resumed, otherwise start clean */
+	if (checkpoint_load(file) < 0) {
+		(void)lcz_lwm2m_sw_mgmt_file_delete(file);
+	}
+#else
+	/* Delete the download file if it exists */
+	(void)lcz_lwm2m_sw_mgmt_file_delete(file);
+#endif
+
+	return file;
+}
+
+int lcz_lwm2m_sw_mgmt_file_write(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t *data,
+				 uint16_t data_len, bool last_block, size_t total_size)
+{
+	int ret = 0;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	size_t offset;
+	size_t skip;
+#endif
+
+	if (data_len > 0 && total_size > 0) {
+		file->bytes_downloaded += data_len;
+		if (file->bytes_downloaded == data_len || file->bytes_downloaded > total_size) {
+			/* Starting a new download */
+			file->bytes_downloaded = data_len;
+			ret = start_download(file, total_size);
+			if (ret < 0) {
+				goto exit;
+			}
+		}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+		/* Don't rewrite what a previous (interrupted) download already stored */
+		offset = file->bytes_downloaded - data_len;
+		if (offset < file->resume_offset) {
+			skip = MIN(file->resume_offset - offset, data_len);
+			ret = staging_write(file, data + skip, data_len - skip);
+		} else {
+			ret = staging_write(file, data, data_len);
+		}
+#else
+		ret = staging_write(file, data, data_len);
+#endif
+		if (ret < 0) {
+			goto exit;
+		}
+
+		if (lcz_lwm2m_sw_mgmt_progress_due(&file->download_pct,
+						   file->bytes_downloaded * 100 / total_size)) {
+			LOG_INF("[%d] Download %zu/%zu (%d%%)", file->obj_inst,
+				file->bytes_downloaded, total_size, file->download_pct);
+		}
+
+		if (last_block) {
+			/* Blocks lost to an earlier error would otherwise leave a short image */
+			if (file->bytes_downloaded != total_size) {
+				LOG_ERR("[%d] Download ended at %zu of %zu bytes", file->obj_inst,
+					file->bytes_downloaded, total_size);
+				ret = -EIO;
+				goto exit;
+			}
+			ret = staging_flush(file);
+			if (ret < 0) {
+				goto exit;
+			}
+			LOG_INF("[%d] Download complete: %u blocks, %u file writes", file->obj_inst,
+				file->staging.blocks, file->staging.flushes);
+			staging_reset(file);
+			file->file_size = file->bytes_downloaded;
+			file->bytes_downloaded = 0;
+			file->downloaded = true;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+			file->slots.state[file->slots.write_slot] =
+				LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED;
+			file->slots.size[file->slots.write_slot] = file->file_size;
+			file->slots.install_slot = file->slots.write_slot;
+			ret = slots_save(file);
+#endif
+		}
+	}
+
+exit:
+	if (ret < 0) {
+		/* Staged data may have been dropped, so the next block can't be appended. A retry
+		 * of the first block must start the download again.
+		 */
+		file->bytes_downloaded = 0;
+	}
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_file_flush(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	int ret;
+
+	ret = staging_flush(file);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	/* The caller expects what was written so far to survive a reset */
+	if (ret == 0 && file->checkpoint.magic == CHECKPOINT_MAGIC &&
+	    file->checkpoint.committed != file->staging.committed) {
+		ret = checkpoint_save(file);
+	}
+#endif
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_file_delete(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	/* Only the write slot is deleted, the other slot keeps its package */
+	if (file->slots.write_slot == file->slots.install_slot) {
+		file->downloaded = false;
+		file->file_size = 0;
+	}
+	file->slots.state[file->slots.write_slot] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_EMPTY;
+	(void)slots_save(file);
+#else
+	file->downloaded = false;
+	file->file_size = 0;
+#endif
+
+	return delete_files(file);
+}
+
+void lcz_lwm2m_sw_mgmt_file_restart(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_RESUME)
+	/* The checkpoint must cover the whole file for start_download() to resume it */
+	if (file->bytes_downloaded > 0 && lcz_lwm2m_sw_mgmt_file_flush(file) < 0) {
+		file->checkpoint_valid = false;
+	}
+#endif
+	staging_reset(file);
+	file->bytes_downloaded = 0;
+}
+
+size_t lcz_lwm2m_sw_mgmt_file_offset(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	return file->bytes_downloaded;
+}
+
+bool lcz_lwm2m_sw_mgmt_file_is_downloaded(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	return file->downloaded;
+}
+
+size_t lcz_lwm2m_sw_mgmt_file_size(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+	return file->file_size;
+}
+
+const char *lcz_lwm2m_sw_mgmt_file_path(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	return file->slot_path[file->slots.install_slot];
+#else
+	return file->path;
+#endif
+}
+
+struct lcz_lwm2m_sw_mgmt_file *lcz_lwm2m_sw_mgmt_file_find(uint16_t obj_inst)
+{
+	struct lcz_lwm2m_sw_mgmt_file *file = NULL;
+	int i;
+
+	k_mutex_lock(&file_pool_lock, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(file_pool); i++) {
+		if (file_pool[i].in_use && file_pool[i].obj_inst == obj_inst) {
+			file = &file_pool[i];
+			break;
+		}
+	}
+	k_mutex_unlock(&file_pool_lock);
+	return file;
+}
+
+int lcz_lwm2m_sw_mgmt_file_install_begin(struct lcz_lwm2m_sw_mgmt_file *file)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	if (!file->downloaded) {
+		return -ENOENT;
+	}
+
+	file->slots.state[file->slots.install_slot] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING;
+	return slots_save(file);
+#else
+	ARG_UNUSED(file);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_file_install_end(struct lcz_lwm2m_sw_mgmt_file *file, int result)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	uint8_t slot = file->slots.install_slot;
+
+	if (file->slots.state[slot] != LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING) {
+		return -EINVAL;
+	}
+
+	if (result < 0) {
+		/* Keep the package so the install can be retried without a download */
+		file->slots.state[slot] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED;
+	} else {
+		LOG_INF("[%d] Slot %c is the last good image", file->obj_inst, 'a' + slot);
+		file->slots.state[slot] = LCZ_LWM2M_SW_MGMT_FILE_SLOT_GOOD;
+		file->downloaded = false;
+		file->file_size = 0;
+	}
+	return slots_save(file);
+#else
+	ARG_UNUSED(file);
+	ARG_UNUSED(result);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_file_select_slot(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	struct slots *slots = &file->slots;
+	int i;
+
+	if (slot >= SLOT_COUNT) {
+		return -EINVAL;
+	}
+	if (slots->state[slot] != LCZ_LWM2M_SW_MGMT_FILE_SLOT_DOWNLOADED &&
+	    slots->state[slot] != LCZ_LWM2M_SW_MGMT_FILE_SLOT_GOOD) {
+		return -ENOENT;
+	}
+	for (i = 0; i < SLOT_COUNT; i++) {
+		if (slots->state[i] == LCZ_LWM2M_SW_MGMT_FILE_SLOT_INSTALLING) {
+			return -EBUSY;
+		}
+	}
+
+	slots->install_slot = slot;
+	file->downloaded = true;
+	file->file_size = slots->size[slot];
+	return slots_save(file);
+#else
+	ARG_UNUSED(file);
+	ARG_UNUSED(slot);
+	return -ENOTSUP;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_file_slot_info(struct lcz_lwm2m_sw_mgmt_file *file, uint8_t slot,
+				     struct lcz_lwm2m_sw_mgmt_file_slot_info *info)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	if (slot >= SLOT_COUNT || info == NULL) {
+		return -EINVAL;
+	}
+
+	info->state = file->slots.state[slot];
+	info->size = file->slots.size[slot];
+	info->write = (file->slots.write_slot == slot);
+	info->install = (file->slots.install_slot == slot);
+	return 0;
+#else
+	ARG_UNUSED(file);
+	ARG_UNUSED(slot);
+	ARG_UNUSED(info);
+	return -ENOTSUP;
+#endif
+}
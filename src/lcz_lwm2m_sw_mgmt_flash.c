@@ -0,0 +1,613 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_flash.c
+ * @brief Flash partition staging backend for LwM2M software management.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_flash, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/storage/stream_flash.h>
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+#include <zephyr/fs/fs.h>
+#include <zephyr/fs/fs_sys.h>
+#include <stdlib.h>
+#endif
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#include "lcz_lwm2m_sw_mgmt_flash.h"
+#include "lcz_lwm2m_sw_mgmt_trace.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define FLASH_BUF_SIZE CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_BUF_SIZE
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+/* Longest a write waits for the eraser to finish one page */
+#define ERASE_PAGE_TIMEOUT K_SECONDS(10)
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+#define FS_MOUNT_POINT CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS_MOUNT_POINT
+#define FS_TYPE_STAGING FS_TYPE_EXTERNAL_BASE
+/* Mount point, separator and object instance */
+#define FS_PATH_SIZE (sizeof(FS_MOUNT_POINT) + 6)
+#endif
+
+struct lcz_lwm2m_sw_mgmt_flash {
+	bool in_use;
+	uint16_t obj_inst;
+	const struct flash_area *fa;
+	struct stream_flash_ctx stream;
+	size_t bytes_downloaded;
+	size_t image_size;
+	bool downloaded;
+	/* Last progress percentage logged */
+	int download_pct;
+	/* Number of download blocks received for the current download */
+	uint32_t blocks;
+	/* Number of flash writes performed for the current download */
+	uint32_t flushes;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+	struct k_work erase_work;
+	/* End of the area the current download needs erased */
+	size_t erase_end;
+	/* The partition is erased from its start up to this offset */
+	atomic_t erased_to;
+	atomic_t erase_err;
+	/* Given each time the eraser finishes a page */
+	struct k_sem erase_sem;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+	char path[FS_PATH_SIZE];
+	/* One reader at a time, which is all an install needs */
+	bool fs_open;
+	size_t fs_offset;
+#endif
+	uint8_t buf[FLASH_BUF_SIZE] __aligned(4);
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int start_download(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t total_size);
+static int stream_write(struct lcz_lwm2m_sw_mgmt_flash *flash, uint8_t *data, size_t len,
+			bool flush);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+static void erase_work_cb(struct k_work *work);
+static void erase_start(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t size);
+static int erase_wait(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t end);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+static struct lcz_lwm2m_sw_mgmt_flash *view_lookup(const struct fs_mount_t *mountp,
+						   const char *path);
+static int view_open(struct fs_file_t *filp, const char *fs_path, fs_mode_t flags);
+static ssize_t view_read(struct fs_file_t *filp, void *dest, size_t nbytes);
+static int view_lseek(struct fs_file_t *filp, off_t off, int whence);
+static off_t view_tell(struct fs_file_t *filp);
+static int view_close(struct fs_file_t *filp);
+static int view_mount(struct fs_mount_t *mountp);
+static int view_stat(struct fs_mount_t *mountp, const char *path, struct fs_dirent *entry);
+static int view_start(void);
+#endif
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct lcz_lwm2m_sw_mgmt_flash flash_pool[CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_COUNT];
+static K_MUTEX_DEFINE(flash_pool_lock);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+static K_THREAD_STACK_DEFINE(erase_stack, CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_ERASE_STACK_SIZE);
+static struct k_work_q erase_work_q;
+static bool erase_work_q_started;
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+static const struct fs_file_system_t view_fs = {
+	.open = view_open,
+	.read = view_read,
+	.lseek = view_lseek,
+	.tell = view_tell,
+	.close = view_close,
+	.mount = view_mount,
+	.stat = view_stat,
+};
+
+static struct fs_mount_t view_mnt = {
+	.type = FS_TYPE_STAGING,
+	.mnt_point = FS_MOUNT_POINT,
+};
+
+static bool view_mounted;
+#endif
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+/* Erase the pages of the current download, in order, ahead of the writer */
+static void erase_work_cb(struct k_work *work)
+{
+	int ret;
+	struct lcz_lwm2m_sw_mgmt_flash *flash =
+		CONTAINER_OF(work, struct lcz_lwm2m_sw_mgmt_flash, erase_work);
+	const struct device *dev = flash_area_get_device(flash->fa);
+	struct flash_pages_info info;
+	size_t offset = atomic_get(&flash->erased_to);
+
+	while (offset < flash->erase_end) {
+		ret = flash_get_page_info_by_offs(dev, flash->fa->fa_off + offset, &info);
+		if (ret == 0) {
+			ret = flash_area_erase(flash->fa, info.start_offset - flash->fa->fa_off,
+					       info.size);
+		}
+		if (ret < 0) {
+			LOG_ERR("Could not erase at %zu [%d]", offset, ret);
+			atomic_set(&flash->erase_err, ret);
+			k_sem_give(&flash->erase_sem);
+			return;
+		}
+		offset = info.start_offset - flash->fa->fa_off + info.size;
+		atomic_set(&flash->erased_to, offset);
+		k_sem_give(&flash->erase_sem);
+	}
+}
+
+static void erase_start(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t size)
+{
+	struct k_work_sync sync;
+
+	/* A restarted download erases again from the start of the partition. Clearing the end
+	 * stops a running eraser after its current page.
+	 */
+	flash->erase_end = 0;
+	(void)k_work_cancel_sync(&flash->erase_work, &sync);
+	flash->erase_end = size;
+	atomic_set(&flash->erased_to, 0);
+	atomic_set(&flash->erase_err, 0);
+	k_sem_reset(&flash->erase_sem);
+	(void)k_work_submit_to_queue(&erase_work_q, &flash->erase_work);
+}
+
+/* Writes only block if they catch up with the eraser */
+static int erase_wait(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t end)
+{
+	int ret;
+
+	end = MIN(end, flash->erase_end);
+	while (atomic_get(&flash->erased_to) < end) {
+		ret = atomic_get(&flash->erase_err);
+		if (ret < 0) {
+			return ret;
+		}
+		if (k_sem_take(&flash->erase_sem, ERASE_PAGE_TIMEOUT) < 0) {
+			return -ETIMEDOUT;
+		}
+	}
+	return atomic_get(&flash->erase_err);
+}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+/* Staged packages are files named after their object instance, present once downloaded */
+static struct lcz_lwm2m_sw_mgmt_flash *view_lookup(const struct fs_mount_t *mountp,
+						   const char *path)
+{
+	char *end;
+	unsigned long obj_inst;
+	int i;
+
+	path += mountp->mountp_len;
+	if (*path == '/') {
+		path++;
+	}
+
+	obj_inst = strtoul(path, &end, 10);
+	if (end == path || *end != '\0') {
+		return NULL;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(flash_pool); i++) {
+		if (flash_pool[i].in_use && flash_pool[i].obj_inst == obj_inst &&
+		    flash_pool[i].downloaded) {
+			return &flash_pool[i];
+		}
+	}
+	return NULL;
+}
+
+static int view_open(struct fs_file_t *filp, const char *fs_path, fs_mode_t flags)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash;
+
+	if ((flags & (FS_O_WRITE | FS_O_CREATE | FS_O_APPEND)) != 0) {
+		return -EROFS;
+	}
+
+	flash = view_lookup(filp->mp, fs_path);
+	if (flash == NULL) {
+		return -ENOENT;
+	}
+	if (flash->fs_open) {
+		return -EBUSY;
+	}
+
+	flash->fs_open = true;
+	flash->fs_offset = 0;
+	filp->filep = flash;
+	return 0;
+}
+
+static ssize_t view_read(struct fs_file_t *filp, void *dest, size_t nbytes)
+{
+	int ret;
+	struct lcz_lwm2m_sw_mgmt_flash *flash = filp->filep;
+
+	nbytes = MIN(nbytes, flash->image_size - flash->fs_offset);
+	if (nbytes == 0) {
+		return 0;
+	}
+
+	ret = flash_area_read(flash->fa, flash->fs_offset, dest, nbytes);
+	if (ret < 0) {
+		return ret;
+	}
+	flash->fs_offset += nbytes;
+	return nbytes;
+}
+
+static int view_lseek(struct fs_file_t *filp, off_t off, int whence)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash = filp->filep;
+	off_t pos;
+
+	switch (whence) {
+	case FS_SEEK_SET:
+		pos = off;
+		break;
+	case FS_SEEK_CUR:
+		pos = flash->fs_offset + off;
+		break;
+	case FS_SEEK_END:
+		pos = flash->image_size + off;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (pos < 0 || pos > flash->image_size) {
+		return -EINVAL;
+	}
+	flash->fs_offset = pos;
+	return 0;
+}
+
+static off_t view_tell(struct fs_file_t *filp)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash = filp->filep;
+
+	return flash->fs_offset;
+}
+
+static int view_close(struct fs_file_t *filp)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash = filp->filep;
+
+	flash->fs_open = false;
+	filp->filep = NULL;
+	return 0;
+}
+
+static int view_mount(struct fs_mount_t *mountp)
+{
+	ARG_UNUSED(mountp);
+
+	return 0;
+}
+
+static int view_stat(struct fs_mount_t *mountp, const char *path, struct fs_dirent *entry)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash = view_lookup(mountp, path);
+
+	if (flash == NULL) {
+		return -ENOENT;
+	}
+
+	entry->type = FS_DIR_ENTRY_FILE;
+	strncpy(entry->name, &flash->path[sizeof(FS_MOUNT_POINT)], sizeof(entry->name) - 1);
+	entry->name[sizeof(entry->name) - 1] = '\0';
+	entry->size = flash->image_size;
+	return 0;
+}
+
+/* Called with the pool locked */
+static int view_start(void)
+{
+	int ret;
+
+	if (view_mounted) {
+		return 0;
+	}
+
+	ret = fs_register(FS_TYPE_STAGING, &view_fs);
+	if (ret == 0) {
+		ret = fs_mount(&view_mnt);
+	}
+	if (ret < 0) {
+		LOG_ERR("Could not mount %s [%d]", FS_MOUNT_POINT, ret);
+		return ret;
+	}
+	view_mounted = true;
+	return 0;
+}
+#endif
+
+static int start_download(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t total_size)
+{
+	int ret;
+	const struct device *dev;
+	size_t align;
+	size_t buf_len;
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+	/* Don't overwrite a package while it is being installed */
+	if (flash->fs_open) {
+		return -EBUSY;
+	}
+#endif
+
+	flash->downloaded = false;
+	flash->image_size = 0;
+	flash->download_pct = 0;
+	flash->blocks = 0;
+	flash->flushes = 0;
+
+	if (total_size > flash->fa->fa_size) {
+		LOG_ERR("Package (%zu) larger than partition (%zu)", total_size,
+			flash->fa->fa_size);
+		return -EFBIG;
+	}
+
+	/* Data is written once this much is buffered, whole write blocks only */
+	dev = flash_area_get_device(flash->fa);
+	align = flash_get_write_block_size(dev);
+	buf_len = MIN(lcz_lwm2m_sw_mgmt_params()->flush_threshold, sizeof(flash->buf));
+	buf_len = MAX(ROUND_DOWN(buf_len, align), MIN(align, sizeof(flash->buf)));
+
+	/* Restarting the stream also restarts erase-ahead at the first page */
+	ret = stream_flash_init(&flash->stream, dev, flash->buf, buf_len, flash->fa->fa_off,
+				flash->fa->fa_size, NULL);
+	if (ret < 0) {
+		LOG_ERR("Could not start flash stream [%d]", ret);
+		return ret;
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+	erase_start(flash, total_size);
+#endif
+	return 0;
+}
+
+static int stream_write(struct lcz_lwm2m_sw_mgmt_flash *flash, uint8_t *data, size_t len,
+			bool flush)
+{
+	int ret;
+	size_t written;
+	uint32_t start;
+	/* Most calls only fill the stream buffer, trace the ones that reach the flash */
+	bool traced = flush || (flash->stream.buf_bytes + len >= flash->stream.buf_len);
+
+	if (traced) {
+		SW_MGMT_TRACE_WRITE_START(flash->obj_inst, flash->stream.buf_bytes + len);
+	}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+	/* Anything up to the end of this block may be written by this call */
+	ret = erase_wait(flash, flash->bytes_downloaded);
+	if (ret < 0) {
+		LOG_ERR("Flash erase failed [%d]", ret);
+		if (traced) {
+			SW_MGMT_TRACE_WRITE_END(flash->obj_inst, ret);
+		}
+		return ret;
+	}
+#endif
+
+	written = stream_flash_bytes_written(&flash->stream);
+	start = k_cycle_get_32();
+	ret = stream_flash_buffered_write(&flash->stream, data, len, flush);
+
+	/* Only calls that reached the flash (including any erase) are storage writes */
+	if (ret < 0 || stream_flash_bytes_written(&flash->stream) != written) {
+		lcz_lwm2m_sw_mgmt_stats_storage_write(
+			flash->obj_inst, k_cyc_to_us_floor32(k_cycle_get_32() - start), ret);
+		flash->flushes++;
+	}
+	if (traced) {
+		SW_MGMT_TRACE_WRITE_END(flash->obj_inst, ret);
+	}
+	if (ret < 0) {
+		LOG_ERR("Could not write flash [%d]", ret);
+	}
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+struct lcz_lwm2m_sw_mgmt_flash *lcz_lwm2m_sw_mgmt_flash_open(uint16_t obj_inst, uint8_t area_id)
+{
+	struct lcz_lwm2m_sw_mgmt_flash *flash = NULL;
+	int ret;
+	int i;
+
+	k_mutex_lock(&flash_pool_lock, K_FOREVER);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+	if (!erase_work_q_started) {
+		k_work_queue_start(&erase_work_q, erase_stack, K_THREAD_STACK_SIZEOF(erase_stack),
+				   CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_ERASE_THREAD_PRIORITY, NULL);
+		erase_work_q_started = true;
+	}
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+	if (view_start() < 0) {
+		k_mutex_unlock(&flash_pool_lock);
+		return NULL;
+	}
+#endif
+	for (i = 0; i < ARRAY_SIZE(flash_pool); i++) {
+		if (!flash_pool[i].in_use) {
+			flash = &flash_pool[i];
+			flash->in_use = true;
+			break;
+		}
+	}
+	k_mutex_unlock(&flash_pool_lock);
+
+	if (flash == NULL) {
+		LOG_ERR("No free staging partition for instance %d", obj_inst);
+		return NULL;
+	}
+
+	ret = flash_area_open(area_id, &flash->fa);
+	if (ret < 0) {
+		LOG_ERR("Could not open flash area %d [%d]", area_id, ret);
+		flash->in_use = false;
+		return NULL;
+	}
+
+	flash->obj_inst = obj_inst;
+	flash->bytes_downloaded = 0;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_PRE_ERASE)
+	k_work_init(&flash->erase_work, erase_work_cb);
+	k_sem_init(&flash->erase_sem, 0, K_SEM_MAX_LIMIT);
+	flash->erase_end = 0;
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+	snprintk(flash->path, sizeof(flash->path), "%s/%d", FS_MOUNT_POINT, obj_inst);
+	flash->fs_open = false;
+#endif
+	lcz_lwm2m_sw_mgmt_flash_discard(flash);
+	return flash;
+}
+
+int lcz_lwm2m_sw_mgmt_flash_write(struct lcz_lwm2m_sw_mgmt_flash *flash, uint8_t *data,
+				  uint16_t data_len, bool last_block, size_t total_size)
+{
+	int ret = 0;
+
+	if (data_len > 0 && total_size > 0) {
+		flash->bytes_downloaded += data_len;
+		if (flash->bytes_downloaded == data_len || flash->bytes_downloaded > total_size) {
+			/* Starting a new download */
+			flash->bytes_downloaded = data_len;
+			ret = start_download(flash, total_size);
+			if (ret < 0) {
+				goto exit;
+			}
+		}
+
+		/* Blocks lost to an earlier error would otherwise leave a short image */
+		if (last_block && flash->bytes_downloaded != total_size) {
+			LOG_ERR("[%d] Download ended at %zu of %zu bytes", flash->obj_inst,
+				flash->bytes_downloaded, total_size);
+			ret = -EIO;
+			goto exit;
+		}
+
+		flash->blocks++;
+		ret = stream_write(flash, data, data_len, last_block);
+		if (ret < 0) {
+			goto exit;
+		}
+
+		if (lcz_lwm2m_sw_mgmt_progress_due(&flash->download_pct,
+						   flash->bytes_downloaded * 100 / total_size)) {
+			LOG_INF("[%d] Download %zu/%zu (%d%%)", flash->obj_inst,
+				flash->bytes_downloaded, total_size, flash->download_pct);
+		}
+
+		if (last_block) {
+			LOG_INF("[%d] Download complete: %u blocks, %u flash writes",
+				flash->obj_inst, flash->blocks, flash->flushes);
+			flash->image_size = flash->bytes_downloaded;
+			flash->bytes_downloaded = 0;
+			flash->downloaded = true;
+		}
+	}
+
+exit:
+	if (ret < 0) {
+		/* Buffered data may have been dropped, so the next block can't be appended. A retry
+		 * of the first block must start the download again.
+		 */
+		flash->bytes_downloaded = 0;
+	}
+	return ret;
+}
+
+int lcz_lwm2m_sw_mgmt_flash_flush(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	/* Nothing has been streamed yet */
+	if (flash->bytes_downloaded == 0) {
+		return 0;
+	}
+	return stream_write(flash, NULL, 0, true);
+}
+
+void lcz_lwm2m_sw_mgmt_flash_discard(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	flash->downloaded = false;
+	flash->image_size = 0;
+}
+
+void lcz_lwm2m_sw_mgmt_flash_restart(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	flash->bytes_downloaded = 0;
+}
+
+size_t lcz_lwm2m_sw_mgmt_flash_offset(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	return flash->bytes_downloaded;
+}
+
+bool lcz_lwm2m_sw_mgmt_flash_is_downloaded(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	return flash->downloaded;
+}
+
+size_t lcz_lwm2m_sw_mgmt_flash_size(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+	return flash->image_size;
+}
+
+const char *lcz_lwm2m_sw_mgmt_flash_path(struct lcz_lwm2m_sw_mgmt_flash *flash)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_FS)
+	return flash->downloaded ? flash->path : NULL;
+#else
+	ARG_UNUSED(flash);
+	return NULL;
+#endif
+}
+
+int lcz_lwm2m_sw_mgmt_flash_read(struct lcz_lwm2m_sw_mgmt_flash *flash, size_t offset,
+				 uint8_t *data, size_t data_len)
+{
+	if (offset + data_len > flash->fa->fa_size) {
+		return -EINVAL;
+	}
+	return flash_area_read(flash->fa, offset, data, data_len);
+}
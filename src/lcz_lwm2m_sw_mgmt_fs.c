@@ -0,0 +1,51 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_fs.c
+ * @brief File system helpers shared by the software management backends
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_fs, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/fs/fs.h>
+#include <file_system_utilities.h>
+
+#include "lcz_lwm2m_sw_mgmt_fs.h"
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_fs_reserve(size_t needed, const char *replaced)
+{
+	int ret;
+	struct fs_statvfs stat;
+	uint64_t avail;
+
+	ret = fs_statvfs(CONFIG_FSU_MOUNT_POINT, &stat);
+	if (ret < 0) {
+		/* Not all file systems report free space, let the download try */
+		LOG_WRN("Could not get free space [%d]", ret);
+		return 0;
+	}
+
+	avail = (uint64_t)stat.f_bfree * stat.f_frsize;
+	if (replaced != NULL) {
+		ret = fsu_get_file_size_abs(replaced);
+		if (ret > 0) {
+			avail += ret;
+		}
+	}
+
+	if (avail < needed) {
+		LOG_ERR("Not enough space: %zu bytes needed, %u free", needed, (uint32_t)avail);
+		return -ENOSPC;
+	}
+	return 0;
+}
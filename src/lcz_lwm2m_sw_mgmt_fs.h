@@ -0,0 +1,45 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_fs.h
+ * @brief File system helpers shared by the software management backends
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_FS_H__
+#define __LCZ_LWM2M_SW_MGMT_FS_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Check that a file of the given size fits in the file system, so a package that can't
+ * be stored is rejected before any of it is downloaded.
+ *
+ * A file system that doesn't report its free space is assumed to have room.
+ *
+ * @param needed bytes the file will take, including any margin
+ * @param replaced optional path of a file that is deleted before the new one is written, its
+ * size counts as free
+ * @return int 0 if there is room, -ENOSPC if not
+ */
+int lcz_lwm2m_sw_mgmt_fs_reserve(size_t needed, const char *replaced);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_FS_H__ */
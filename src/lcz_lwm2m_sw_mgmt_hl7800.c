@@ -17,68 +17,361 @@ LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_hl7800, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG
 #include <zephyr/drivers/modem/hl7800.h>
 #include <zephyr/net/lwm2m.h>
 #include <lwm2m_engine.h>
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
+#include <zephyr/fs/fs.h>
+#include <zephyr/storage/flash_map.h>
 #include <file_system_utilities.h>
+#endif
 
 #include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#include "lcz_lwm2m_sw_mgmt_trace.h"
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+#include "lcz_lwm2m_sw_mgmt_sched.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
+#include "lcz_lwm2m_sw_mgmt_flash.h"
+#include "lcz_lwm2m_sw_mgmt_fs.h"
+#else
+#include "lcz_lwm2m_sw_mgmt_file.h"
+#endif
 
 /**************************************************************************************************/
 /* Local Constant, Macro and Type Definitions                                                     */
 /**************************************************************************************************/
+#define OBJ_INST CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST
+
+BUILD_ASSERT(OBJ_INST < CONFIG_LCZ_LWM2M_SW_MGMT_MAX_INSTANCES, "HL7800 instance out of range");
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH) &&                                       \
+	!defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_DIRECT)
+#define EXPORT_TO_FILE
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
 #define UPDATE_FILE_PATH CONFIG_FSU_MOUNT_POINT "/" CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_FILE_NAME
+#define STAGING_AREA_ID DT_FIXED_PARTITION_ID(DT_NODELABEL(hl7800_staging_partition))
+/* Chunk size used to copy the staged image to the file the modem driver installs from */
+#define EXPORT_CHUNK_SIZE 512
+#endif
 
 /**************************************************************************************************/
 /* Local Function Prototypes                                                                      */
 /**************************************************************************************************/
 static int sw_mgmt_event(lcz_lwm2m_sw_mgmt_event_t event);
 static void *sw_mgmt_read_ver_cb(void);
-static int sw_mgmt_download_data_cb(uint8_t *data, uint16_t data_len, bool last_block,
-				    size_t total_size);
+static int sw_mgmt_download_data_cb(size_t offset, const struct lcz_lwm2m_sw_mgmt_chunk *chunks,
+				    size_t chunk_count, bool last_block, size_t total_size);
 static void hl7800_event_cb(enum mdm_hl7800_event event, void *event_data);
 static int lcz_lwm2m_sw_mgmt_hl780_init(const struct device *device);
+static void install_start(uint16_t obj_inst);
+static void install_run(void);
+#if defined(EXPORT_TO_FILE)
+static void install_work_cb(struct k_work *work);
+#endif
+#if !defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
 static void start_fw_update_work_cb(struct k_work *work);
-static int delete_update_file(void);
+#endif
+static int staging_open(void);
+static int staging_flush(void);
+static void staging_delete(void);
+static bool staging_is_downloaded(void);
+static size_t staging_offset(void);
+static void staging_restart(void);
+static int staging_write(uint8_t *data, uint16_t data_len, bool last_block, size_t total_size);
+static size_t staging_size(void);
+static int staging_install_path(char **path);
+static int staging_install_begin(void);
+static void staging_install_end(int result);
+static void install_end(int result);
 
 /**************************************************************************************************/
 /* Local Data Definitions                                                                         */
 /**************************************************************************************************/
 static struct lcz_lwm2m_sw_mgmt_event_callback_agent event_agent;
-static int bytes_downloaded = 0;
-static int update_file_size = 0;
-static bool file_downloaded = false;
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
+static struct lcz_lwm2m_sw_mgmt_flash *update_flash;
+#endif
+#if defined(EXPORT_TO_FILE)
+static uint8_t export_buf[EXPORT_CHUNK_SIZE];
+static K_THREAD_STACK_DEFINE(export_stack, CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_EXPORT_STACK_SIZE);
+static struct k_work_q export_work_q;
+static K_WORK_DEFINE(install_work, install_work_cb);
+#endif
+#if !defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
+static struct lcz_lwm2m_sw_mgmt_file *update_file;
+#endif
 static struct mdm_hl7800_callback_agent hl7800_evt_agent;
+static const struct lcz_lwm2m_sw_mgmt_update init_update = {
+	.fields = LCZ_LWM2M_SW_MGMT_UPDATE_PKG_NAME | LCZ_LWM2M_SW_MGMT_UPDATE_ACTIVATE,
+	.pkg_name = CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_PKG_NAME,
+	.activate = true,
+};
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+/* The install reboots the modem, so it is grouped with other installs that drop the connection */
+static const struct lcz_lwm2m_sw_mgmt_install_desc install_desc = {
+	.start = install_start,
+	.flags = LCZ_LWM2M_SW_MGMT_INSTALL_RESET,
+	.priority = CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_PRIORITY,
+	.after = CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_AFTER,
+};
+#else
 static K_WORK_DELAYABLE_DEFINE(start_fw_update_work, start_fw_update_work_cb);
+#endif
+/* Last progress percentage logged for the transfer to the modem */
+static int install_pct;
+/* Set while the modem installs a package from this module */
+static bool install_active;
+static size_t install_size;
 
 /**************************************************************************************************/
 /* Local Function Definitions                                                                     */
 /**************************************************************************************************/
-static int delete_update_file(void)
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_STORAGE_FLASH)
+static int staging_open(void)
+{
+	update_flash = lcz_lwm2m_sw_mgmt_flash_open(OBJ_INST, STAGING_AREA_ID);
+	if (update_flash == NULL) {
+		return -ENOMEM;
+	}
+
+	/* Remove a copy left by an install that was interrupted */
+	staging_delete();
+	return 0;
+}
+
+static int staging_flush(void)
+{
+	return lcz_lwm2m_sw_mgmt_flash_flush(update_flash);
+}
+
+static void staging_delete(void)
+{
+	lcz_lwm2m_sw_mgmt_flash_discard(update_flash);
+	/* Also removes a copy made before the install was direct */
+	if (fsu_get_file_size_abs(UPDATE_FILE_PATH) > 0) {
+		(void)fsu_delete_abs(UPDATE_FILE_PATH);
+	}
+}
+
+static bool staging_is_downloaded(void)
+{
+	return lcz_lwm2m_sw_mgmt_flash_is_downloaded(update_flash);
+}
+
+static size_t staging_size(void)
+{
+	return lcz_lwm2m_sw_mgmt_flash_size(update_flash);
+}
+
+static size_t staging_offset(void)
+{
+	return lcz_lwm2m_sw_mgmt_flash_offset(update_flash);
+}
+
+static void staging_restart(void)
 {
+	lcz_lwm2m_sw_mgmt_flash_restart(update_flash);
+}
+
+static int staging_write(uint8_t *data, uint16_t data_len, bool last_block, size_t total_size)
+{
+#if defined(EXPORT_TO_FILE)
 	int ret;
 
-	ret = fsu_get_file_size_abs(UPDATE_FILE_PATH);
-	if (ret > 0) {
-		ret = fsu_delete_abs(UPDATE_FILE_PATH);
-	} else {
-		ret = 0;
+	/* The install copies the image to a file, so a package that can't fit there is rejected
+	 * before it is downloaded. A copy left by an earlier install is replaced.
+	 */
+	if (staging_offset() == 0) {
+		ret = lcz_lwm2m_sw_mgmt_fs_reserve(total_size, UPDATE_FILE_PATH);
+		if (ret < 0) {
+			return ret;
+		}
 	}
-	return ret;
+#endif
+	return lcz_lwm2m_sw_mgmt_flash_write(update_flash, data, data_len, last_block, total_size);
+}
+
+static int staging_install_begin(void)
+{
+	return 0;
+}
+
+static void staging_install_end(int result)
+{
+	if (result == 0) {
+		staging_delete();
+	}
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_DIRECT)
+/* The modem driver reads the staging partition through the file view */
+static int staging_install_path(char **path)
+{
+	*path = (char *)lcz_lwm2m_sw_mgmt_flash_path(update_flash);
+	return *path == NULL ? -ENOENT : 0;
+}
+#else
+/* The modem driver only installs from a file. Copy the staged image in one sequential pass so
+ * the file system is touched once per install instead of once per download block.
+ */
+static int staging_install_path(char **path)
+{
+	int ret;
+	struct fs_file_t f;
+	size_t offset;
+	size_t size;
+	size_t chunk;
+
+	size = lcz_lwm2m_sw_mgmt_flash_size(update_flash);
+	if (size == 0) {
+		return -ENOENT;
+	}
+
+	if (fsu_get_file_size_abs(UPDATE_FILE_PATH) > 0) {
+		(void)fsu_delete_abs(UPDATE_FILE_PATH);
+	}
+
+	fs_file_t_init(&f);
+	ret = fs_open(&f, UPDATE_FILE_PATH, FS_O_CREATE | FS_O_WRITE);
+	if (ret < 0) {
+		LOG_ERR("Could not open update file [%d]", ret);
+		return ret;
+	}
+
+	for (offset = 0; offset < size; offset += chunk) {
+		chunk = MIN(size - offset, sizeof(export_buf));
+		ret = lcz_lwm2m_sw_mgmt_flash_read(update_flash, offset, export_buf, chunk);
+		if (ret < 0) {
+			break;
+		}
+		ret = fs_write(&f, export_buf, chunk);
+		if (ret >= 0 && (size_t)ret != chunk) {
+			ret = -ENOSPC;
+		}
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	if (fs_close(&f) < 0 && ret >= 0) {
+		ret = -EIO;
+	}
+	if (ret < 0) {
+		LOG_ERR("Could not copy update to file [%d]", ret);
+		return ret;
+	}
+
+	*path = UPDATE_FILE_PATH;
+	return 0;
+}
+#endif
+#else
+static int staging_open(void)
+{
+	/* Keeps a partial download that can be resumed, otherwise starts clean */
+	update_file = lcz_lwm2m_sw_mgmt_file_open(OBJ_INST,
+						  CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_FILE_NAME);
+	return update_file == NULL ? -ENOMEM : 0;
+}
+
+static int staging_flush(void)
+{
+	return lcz_lwm2m_sw_mgmt_file_flush(update_file);
+}
+
+static void staging_delete(void)
+{
+	(void)lcz_lwm2m_sw_mgmt_file_delete(update_file);
 }
 
+static bool staging_is_downloaded(void)
+{
+	return lcz_lwm2m_sw_mgmt_file_is_downloaded(update_file);
+}
+
+static size_t staging_size(void)
+{
+	return lcz_lwm2m_sw_mgmt_file_size(update_file);
+}
+
+static size_t staging_offset(void)
+{
+	return lcz_lwm2m_sw_mgmt_file_offset(update_file);
+}
+
+static void staging_restart(void)
+{
+	/* The file backend resumes what is staged if the package id matches its checkpoint */
+	lcz_lwm2m_sw_mgmt_file_restart(update_file);
+}
+
+static int staging_write(uint8_t *data, uint16_t data_len, bool last_block, size_t total_size)
+{
+	return lcz_lwm2m_sw_mgmt_file_write(update_file, data, data_len, last_block, total_size);
+}
+
+static int staging_install_path(char **path)
+{
+	*path = (char *)lcz_lwm2m_sw_mgmt_file_path(update_file);
+	return 0;
+}
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+/* The slot stays reserved during the install so the next download goes to the other slot */
+static int staging_install_begin(void)
+{
+	return lcz_lwm2m_sw_mgmt_file_install_begin(update_file);
+}
+
+static void staging_install_end(int result)
+{
+	/* The installed image is kept as the last good image */
+	(void)lcz_lwm2m_sw_mgmt_file_install_end(update_file, result);
+}
+#else
+static int staging_install_begin(void)
+{
+	return 0;
+}
+
+static void staging_install_end(int result)
+{
+	if (result == 0) {
+		staging_delete();
+	}
+}
+#endif
+#endif
+
 static int sw_mgmt_event(lcz_lwm2m_sw_mgmt_event_t event)
 {
 	int ret;
 	LOG_DBG("event %d", event);
 	switch (event) {
 	case LCZ_LWM2M_SW_MGMT_EVENT_INSTALL:
+		/* Make sure nothing is left in RAM if the last block was never seen */
+		ret = staging_flush();
+		if (ret < 0) {
+			break;
+		}
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+		ret = lcz_lwm2m_sw_mgmt_schedule_install(OBJ_INST, &install_desc);
+#else
 		k_work_reschedule(&start_fw_update_work,
-				  K_SECONDS(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_DELAY_SECONDS));
+				  K_SECONDS(lcz_lwm2m_sw_mgmt_params()->install_delay_s));
 		ret = 0;
+#endif
 		break;
 	case LCZ_LWM2M_SW_MGMT_EVENT_UNINSTALL:
 		/* Uninstall event used to reset state machine to allow for another install/update.
 		 * Return 0 for the callback to allow the uninstall execution to continue without error
 		 * and let the software management object state machine to reset its state properly.
+		 * Anything still staged belongs to an aborted download, so flush it to keep the
+		 * file consistent with the download state.
 		 */
+		(void)staging_flush();
 		ret = 0;
 		break;
 	default:
@@ -88,86 +381,153 @@ static int sw_mgmt_event(lcz_lwm2m_sw_mgmt_event_t event)
 	return ret;
 }
 
-static void start_fw_update_work_cb(struct k_work *work)
+static void install_end(int result)
 {
-	int ret;
+	install_active = false;
+	lcz_lwm2m_sw_mgmt_install_completed(OBJ_INST, result);
+	staging_install_end(result);
+}
+
+static void install_start(uint16_t obj_inst)
+{
+	ARG_UNUSED(obj_inst);
+
+#if defined(EXPORT_TO_FILE)
+	/* The copy to the download file takes too long for the caller's work queue */
+	(void)k_work_submit_to_queue(&export_work_q, &install_work);
+#else
+	install_run();
+#endif
+}
 
+#if defined(EXPORT_TO_FILE)
+static void install_work_cb(struct k_work *work)
+{
 	ARG_UNUSED(work);
 
-	ret = mdm_hl7800_update_fw(UPDATE_FILE_PATH);
+	install_run();
+}
+#endif
+
+static void install_run(void)
+{
+	int ret;
+	char *path;
+
+	install_pct = 0;
+	install_size = staging_size();
+	SW_MGMT_TRACE_INSTALL_START(OBJ_INST, install_size);
+	ret = staging_is_downloaded() ? staging_install_begin() : -ENOENT;
+	if (ret < 0) {
+		lcz_lwm2m_sw_mgmt_install_completed(OBJ_INST, ret);
+		return;
+	}
+
+	install_active = true;
+	ret = staging_install_path(&path);
+	if (ret == 0) {
+		ret = mdm_hl7800_update_fw(path);
+	}
 	if (ret < 0) {
-		lwm2m_swmgmt_install_completed(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST, ret);
+		install_end(ret);
 	}
 }
 
+#if !defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+static void start_fw_update_work_cb(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	install_start(OBJ_INST);
+}
+#endif
+
 static void *sw_mgmt_read_ver_cb(void)
 {
 	return (void *)mdm_hl7800_get_fw_version();
 }
 
-static int sw_mgmt_download_data_cb(uint8_t *data, uint16_t data_len, bool last_block,
-				    size_t total_size)
+/* Offset 0 starts a new image, which may be a different package than the one partly staged, so
+ * staging starts again. Any other offset is checked against what is staged, so a retransmitted
+ * block is dropped instead of being staged twice.
+ */
+static int sw_mgmt_download_data_cb(size_t offset, const struct lcz_lwm2m_sw_mgmt_chunk *chunks,
+				    size_t chunk_count, bool last_block, size_t total_size)
 {
 	int ret = 0;
+	size_t staged;
+	size_t skip;
+	size_t pos;
+	size_t i;
+	uint16_t len;
+	bool last;
 
-	if (data_len > 0 && total_size > 0) {
-		bytes_downloaded += data_len;
-		if (bytes_downloaded > total_size) {
-			/* Starting a new download */
-			bytes_downloaded = data_len;
-			file_downloaded = false;
-			ret = delete_update_file();
-			if (ret < 0) {
-				LOG_ERR("Could not delete file [%d]", ret);
-				goto exit;
-			}
-		}
-
-		ret = fsu_append(CONFIG_FSU_MOUNT_POINT, CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_FILE_NAME,
-				 (void *)data, data_len);
-		if (ret < 0) {
-			LOG_ERR("Could not write file [%d]", ret);
-			goto exit;
-		}
-
-		LOG_INF("Download %d/%d (%d%%)", bytes_downloaded, total_size,
-			bytes_downloaded * 100 / total_size);
+	if (offset == 0) {
+		staging_restart();
+	}
 
-		if (last_block) {
-			update_file_size = bytes_downloaded;
-			bytes_downloaded = 0;
-			file_downloaded = true;
-		}
+	staged = staging_offset();
+	if (offset > 0 && staged == 0 && staging_is_downloaded()) {
+		/* Retransmission of the last block */
+		return 0;
+	}
+	if (offset > staged) {
+		LOG_ERR("Download gap: offset %zu, %zu bytes staged", offset, staged);
+		return -EIO;
 	}
 
-exit:
+	skip = staged - offset;
+	for (i = 0; i < chunk_count && ret >= 0; i++) {
+		pos = MIN(skip, chunks[i].len);
+		skip -= pos;
+		do {
+			len = MIN(chunks[i].len - pos, UINT16_MAX);
+			last = last_block && (i == chunk_count - 1) && (pos + len == chunks[i].len);
+			if (len > 0 || last) {
+				ret = staging_write((uint8_t *)chunks[i].data + pos, len, last,
+						    total_size);
+			}
+			pos += len;
+		} while (ret >= 0 && pos < chunks[i].len);
+	}
 	return ret;
 }
 
 static void hl7800_event_cb(enum mdm_hl7800_event event, void *event_data)
 {
 	uint8_t fota_state;
+	uint32_t fota_count;
+	size_t file_size;
+
+	/* The modem reports its new revision after it restarts with updated firmware */
+	if (event == HL7800_EVENT_REVISION) {
+		lcz_lwm2m_sw_mgmt_version_changed(OBJ_INST);
+	}
 
-	if (file_downloaded) {
+	if (install_active) {
 		switch (event) {
 		case HL7800_EVENT_FOTA_STATE:
 			fota_state = *(uint8_t *)event_data;
+			SW_MGMT_TRACE_FOTA_STATE(OBJ_INST, fota_state);
 			if (fota_state == HL7800_FOTA_COMPLETE) {
-				lwm2m_swmgmt_install_completed(
-					CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST, 0);
-				(void)delete_update_file();
-				bytes_downloaded = 0;
+				install_end(0);
 				LOG_INF("HL7800 firmware update complete");
 			} else if (fota_state == HL7800_FOTA_FILE_ERROR) {
-				lwm2m_swmgmt_install_completed(
-					CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST, -EIO);
+				install_end(-EIO);
 			} else if (fota_state == HL7800_FOTA_INSTALL) {
 				LOG_INF("Installing HL7800 firmware");
 			}
 			break;
 		case HL7800_EVENT_FOTA_COUNT:
-			LOG_INF("Firmware write %d/%d (%d%%)", *(uint32_t *)event_data,
-				update_file_size, *(uint32_t *)event_data * 100 / update_file_size);
+			fota_count = *(uint32_t *)event_data;
+			file_size = install_size;
+			SW_MGMT_TRACE_FOTA_COUNT(OBJ_INST, fota_count);
+			lcz_lwm2m_sw_mgmt_stats_install_progress(OBJ_INST, fota_count);
+			if (lcz_lwm2m_sw_mgmt_progress_due(&install_pct,
+							   fota_count * 100 / file_size)) {
+				LOG_INF("Firmware write %u/%zu (%d%%)", fota_count, file_size,
+					install_pct);
+			}
 			break;
 		default:
 			break;
@@ -189,36 +549,43 @@ static int lcz_lwm2m_sw_mgmt_hl780_init(const struct device *device)
 
 	ARG_UNUSED(device);
 
+#if defined(EXPORT_TO_FILE)
+	k_work_queue_start(&export_work_q, export_stack, K_THREAD_STACK_SIZEOF(export_stack),
+			   CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_EXPORT_THREAD_PRIORITY, NULL);
+#endif
+
+	ret = staging_open();
+	if (ret < 0) {
+		LOG_ERR("Open update storage [%d]", ret);
+		goto exit;
+	}
+
 	hl7800_evt_agent.event_callback = hl7800_event_cb;
 	mdm_hl7800_register_event_callback(&hl7800_evt_agent);
 
-	bytes_downloaded = 0;
 	event_agent.event_callback = sw_mgmt_event;
 	event_agent.read_ver_callback = sw_mgmt_read_ver_cb;
-	event_agent.download_data_callback = sw_mgmt_download_data_cb;
-	ret = lcz_lwm2m_sw_mgmt_create_inst(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST, &event_agent);
+	event_agent.download_data_v2_callback = sw_mgmt_download_data_cb;
+	ret = lcz_lwm2m_sw_mgmt_create_inst(OBJ_INST, &event_agent);
 	if (ret < 0) {
 		LOG_ERR("Create obj [%d]", ret);
 		goto exit;
 	}
 
-	ret = lcz_lwm2m_sw_mgmt_set_pkg_name(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST,
-					     CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_PKG_NAME);
-	if (ret < 0) {
-		LOG_ERR("Set HL7800 sw mgmt pkg name [%d]", ret);
-		goto exit;
-	}
-
 	/* HL7800 firmware is always active. Activate, Deactivate, and Uninstall are not allowed */
-	ret = lcz_lwm2m_sw_mgmt_set_activate_state(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST, true);
+	ret = lcz_lwm2m_sw_mgmt_update(OBJ_INST, &init_update);
+	if (ret == -ENOTSUP) {
+		/* Zephyr versions before 3.3 write one resource at a time */
+		ret = lcz_lwm2m_sw_mgmt_set_pkg_name(OBJ_INST, (char *)init_update.pkg_name);
+		if (ret == 0) {
+			ret = lcz_lwm2m_sw_mgmt_set_activate_state(OBJ_INST, init_update.activate);
+		}
+	}
 	if (ret < 0) {
-		LOG_ERR("Set HL7800 sw mgmt active [%d]", ret);
+		LOG_ERR("Set HL7800 sw mgmt pkg name and state [%d]", ret);
 		goto exit;
 	}
 
-	/* Delete the download file if it exists */
-	(void)delete_update_file();
-
 	LOG_DBG("LwM2M software management HL7800 initialized");
 exit:
 	return ret;
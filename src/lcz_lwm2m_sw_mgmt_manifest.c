@@ -0,0 +1,136 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_manifest.c
+ * @brief Package manifest parser
+ *
+ * Manifest format (all integers little endian, strings NUL padded):
+ *
+ *   "LCZM" | header_size (u16) | flags (u8) | reserved (u8) | payload_size (u32) |
+ *   target (16 bytes) | version (32 bytes) | digest (32 bytes)
+ *
+ * header_size is the size of the whole manifest, including the magic. Fields added by newer
+ * manifest versions follow the digest and are skipped. The CRC32 digest uses the first four bytes
+ * of the digest field. The payload follows the manifest.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_manifest, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "lcz_lwm2m_sw_mgmt_manifest.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MANIFEST_MAGIC "LCZM"
+#define MANIFEST_MAGIC_SIZE (sizeof(MANIFEST_MAGIC) - 1)
+
+#define OFFSET_HEADER_SIZE MANIFEST_MAGIC_SIZE
+#define OFFSET_FLAGS (OFFSET_HEADER_SIZE + sizeof(uint16_t))
+#define OFFSET_PAYLOAD_SIZE (OFFSET_FLAGS + 2)
+#define OFFSET_TARGET (OFFSET_PAYLOAD_SIZE + sizeof(uint32_t))
+#define OFFSET_VERSION (OFFSET_TARGET + LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE)
+#define OFFSET_DIGEST (OFFSET_VERSION + LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE)
+
+BUILD_ASSERT(OFFSET_DIGEST + LCZ_LWM2M_SW_MGMT_MANIFEST_DIGEST_SIZE ==
+		     LCZ_LWM2M_SW_MGMT_MANIFEST_SIZE,
+	     "Manifest layout mismatch");
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int decode(struct lcz_lwm2m_sw_mgmt_manifest *manifest);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static int decode(struct lcz_lwm2m_sw_mgmt_manifest *manifest)
+{
+	uint8_t *buf = manifest->buf;
+
+	if (memcmp(buf, MANIFEST_MAGIC, MANIFEST_MAGIC_SIZE) != 0) {
+		return -EBADMSG;
+	}
+
+	manifest->header_size = sys_get_le16(&buf[OFFSET_HEADER_SIZE]);
+	if (manifest->header_size < LCZ_LWM2M_SW_MGMT_MANIFEST_SIZE) {
+		return -EBADMSG;
+	}
+
+	manifest->flags = buf[OFFSET_FLAGS];
+	manifest->payload_size = sys_get_le32(&buf[OFFSET_PAYLOAD_SIZE]);
+	memcpy(manifest->target, &buf[OFFSET_TARGET], LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE);
+	manifest->target[LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE] = '\0';
+	memcpy(manifest->version, &buf[OFFSET_VERSION], LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE);
+	manifest->version[LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE] = '\0';
+	memcpy(manifest->digest, &buf[OFFSET_DIGEST], LCZ_LWM2M_SW_MGMT_MANIFEST_DIGEST_SIZE);
+
+	manifest->remaining = manifest->header_size - LCZ_LWM2M_SW_MGMT_MANIFEST_SIZE;
+	return 0;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+bool lcz_lwm2m_sw_mgmt_manifest_is_present(const uint8_t *data, size_t data_len)
+{
+	return data_len >= MANIFEST_MAGIC_SIZE &&
+	       memcmp(data, MANIFEST_MAGIC, MANIFEST_MAGIC_SIZE) == 0;
+}
+
+void lcz_lwm2m_sw_mgmt_manifest_start(struct lcz_lwm2m_sw_mgmt_manifest *manifest)
+{
+	manifest->len = 0;
+	manifest->remaining = 0;
+	manifest->header_size = 0;
+	manifest->active = true;
+}
+
+int lcz_lwm2m_sw_mgmt_manifest_parse(struct lcz_lwm2m_sw_mgmt_manifest *manifest,
+				     const uint8_t **data, size_t *data_len)
+{
+	int ret;
+	size_t n;
+
+	if (!manifest->active) {
+		return -EINVAL;
+	}
+
+	/* Gather the fixed part, it may be split across blocks */
+	if (manifest->len < sizeof(manifest->buf)) {
+		n = MIN(sizeof(manifest->buf) - manifest->len, *data_len);
+		memcpy(&manifest->buf[manifest->len], *data, n);
+		manifest->len += n;
+		*data += n;
+		*data_len -= n;
+		if (manifest->len < sizeof(manifest->buf)) {
+			return 0;
+		}
+
+		ret = decode(manifest);
+		if (ret < 0) {
+			manifest->active = false;
+			return ret;
+		}
+	}
+
+	/* Skip fields this parser doesn't know about */
+	n = MIN(manifest->remaining, *data_len);
+	manifest->remaining -= n;
+	*data += n;
+	*data_len -= n;
+	if (manifest->remaining > 0) {
+		return 0;
+	}
+
+	manifest->active = false;
+	return 1;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_manifest.h
+ * @brief Package manifest parser used by the software management download path
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_MANIFEST_H__
+#define __LCZ_LWM2M_SW_MGMT_MANIFEST_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE 16
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE 32
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_DIGEST_SIZE 32
+/* Fixed part of the manifest, newer manifests may be longer */
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_SIZE                                                            \
+	(12 + LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE + LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE +   \
+	 LCZ_LWM2M_SW_MGMT_MANIFEST_DIGEST_SIZE)
+
+/* The payload is heatshrink compressed */
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_HEATSHRINK BIT(0)
+/* The payload is a delta patch */
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_DELTA BIT(1)
+/* The digest field is valid */
+#define LCZ_LWM2M_SW_MGMT_MANIFEST_FLAG_DIGEST BIT(2)
+
+struct lcz_lwm2m_sw_mgmt_manifest {
+	bool active;
+	uint8_t buf[LCZ_LWM2M_SW_MGMT_MANIFEST_SIZE];
+	size_t len;
+	/* Bytes of the manifest not consumed yet, including unknown trailing fields */
+	size_t remaining;
+	/* Valid once the manifest has been parsed */
+	uint8_t flags;
+	uint32_t payload_size;
+	size_t header_size;
+	char target[LCZ_LWM2M_SW_MGMT_MANIFEST_TARGET_SIZE + 1];
+	char version[LCZ_LWM2M_SW_MGMT_MANIFEST_VERSION_SIZE + 1];
+	uint8_t digest[LCZ_LWM2M_SW_MGMT_MANIFEST_DIGEST_SIZE];
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Check if the first block of a package starts with a manifest
+ *
+ * @param data first block of the package
+ * @param data_len size of data
+ * @return true if the package starts with the manifest magic
+ */
+bool lcz_lwm2m_sw_mgmt_manifest_is_present(const uint8_t *data, size_t data_len);
+
+/**
+ * @brief Start parsing the manifest of a new package
+ *
+ * @param manifest parser context
+ */
+void lcz_lwm2m_sw_mgmt_manifest_start(struct lcz_lwm2m_sw_mgmt_manifest *manifest);
+
+/**
+ * @brief Consume manifest bytes from a block of the package
+ *
+ * On return, data and data_len describe what is left of the block after the manifest.
+ *
+ * @param manifest parser context
+ * @param data block of the package, advanced past the consumed bytes
+ * @param data_len size of data, reduced by the consumed bytes
+ * @return int 1 when the whole manifest has been consumed, 0 if more data is needed, -EBADMSG if
+ * the manifest is malformed
+ */
+int lcz_lwm2m_sw_mgmt_manifest_parse(struct lcz_lwm2m_sw_mgmt_manifest *manifest,
+				     const uint8_t **data, size_t *data_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_MANIFEST_H__ */
@@ -0,0 +1,194 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_param.c
+ * @brief Tunable parameters of the software management module
+ *
+ * Without attributes the parameters are the Kconfig values. With
+ * CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES they are read from the attributes each time a
+ * download starts, so a server can tune them without a firmware update. With the Kconfig init
+ * mode the attributes that are still 0 are set to the Kconfig values at boot, otherwise the stored
+ * attribute values are used from the start.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_param, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/init.h>
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+#include <attr.h>
+#endif
+
+#include "lcz_lwm2m_sw_mgmt_param.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+/* Upper limits are the sizes the build allocated, 0 if the feature isn't built */
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE)
+#define STAGING_BUF_MAX CONFIG_LCZ_LWM2M_SW_MGMT_FILE_STAGING_BUF_SIZE
+#else
+#define STAGING_BUF_MAX 0
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH)
+#define FLUSH_THRESHOLD_MAX CONFIG_LCZ_LWM2M_SW_MGMT_FLASH_BUF_SIZE
+#else
+#define FLUSH_THRESHOLD_MAX 0
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+#define ASYNC_BATCH_MAX CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_BATCH_COUNT
+#else
+#define ASYNC_BATCH_MAX 1
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+#define PULL_WINDOW_MAX CONFIG_LCZ_LWM2M_SW_MGMT_PULL_WINDOW
+#else
+#define PULL_WINDOW_MAX 1
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_DELAY_SECONDS)
+#define INSTALL_DELAY_S CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_DELAY_SECONDS
+#else
+#define INSTALL_DELAY_S 0
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+#define SCHED_SETTLE_MS CONFIG_LCZ_LWM2M_SW_MGMT_SCHED_SETTLE_MS
+#else
+#define SCHED_SETTLE_MS 0
+#endif
+
+#define PARAMS_KCONFIG                                                                             \
+	{                                                                                          \
+		.progress_step = CONFIG_LCZ_LWM2M_SW_MGMT_PROGRESS_STEP,                           \
+		.staging_buf_size = STAGING_BUF_MAX,                                               \
+		.flush_threshold = FLUSH_THRESHOLD_MAX,                                            \
+		.async_batch = ASYNC_BATCH_MAX,                                                    \
+		.pull_window = PULL_WINDOW_MAX,                                                    \
+		.install_delay_s = INSTALL_DELAY_S,                                                \
+		.sched_settle_ms = SCHED_SETTLE_MS,                                                \
+	}
+
+/* Longest install delay or settle time accepted from an attribute */
+#define DELAY_MAX_S 3600
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+#define LOAD(_field, _name, _min, _max)                                                            \
+	params._field = CLAMP(attr_get_uint32(ATTR_ID_lwm2m_swmgmt_##_name, defaults._field),      \
+			      (_min), (_max))
+/* 0 is the value of an attribute that was never written, a value set by a server is kept */
+#define INIT(_field, _name)                                                                        \
+	do {                                                                                       \
+		if (attr_get_uint32(ATTR_ID_lwm2m_swmgmt_##_name, 0) == 0) {                       \
+			(void)attr_set_uint32(ATTR_ID_lwm2m_swmgmt_##_name, defaults._field);      \
+		}                                                                                  \
+	} while (0)
+#endif
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+static int lcz_lwm2m_sw_mgmt_param_init(const struct device *device);
+#endif
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+static const struct lcz_lwm2m_sw_mgmt_params defaults = PARAMS_KCONFIG;
+#endif
+
+/* Each field is a word, so readers see either the old or the new value of a field */
+static struct lcz_lwm2m_sw_mgmt_params params = PARAMS_KCONFIG;
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+SYS_INIT(lcz_lwm2m_sw_mgmt_param_init, APPLICATION, CONFIG_LCZ_LWM2M_SW_MGMT_INIT_PRIORITY);
+
+static int lcz_lwm2m_sw_mgmt_param_init(const struct device *device)
+{
+	ARG_UNUSED(device);
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_INIT_KCONFIG)
+	INIT(progress_step, progress_step);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE)
+	INIT(staging_buf_size, staging_buf_size);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH)
+	INIT(flush_threshold, flush_threshold);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	INIT(async_batch, async_batch);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+	INIT(pull_window, pull_window);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_DELAY_SECONDS)
+	INIT(install_delay_s, install_delay);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+	INIT(sched_settle_ms, sched_settle_ms);
+#endif
+#endif
+
+	lcz_lwm2m_sw_mgmt_params_load();
+	return 0;
+}
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+void lcz_lwm2m_sw_mgmt_params_load(void)
+{
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TUNABLE_ATTRIBUTES)
+	LOAD(progress_step, progress_step, 1, 100);
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE)
+	LOAD(staging_buf_size, staging_buf_size, 256, STAGING_BUF_MAX);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FLASH)
+	/* The flash backend rounds this down to the write block size */
+	LOAD(flush_threshold, flush_threshold, 16, FLUSH_THRESHOLD_MAX);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+	LOAD(async_batch, async_batch, 1, ASYNC_BATCH_MAX);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+	LOAD(pull_window, pull_window, 1, PULL_WINDOW_MAX);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_INSTALL_DELAY_SECONDS)
+	LOAD(install_delay_s, install_delay, 0, DELAY_MAX_S);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_SCHED)
+	LOAD(sched_settle_ms, sched_settle_ms, 0, DELAY_MAX_S * MSEC_PER_SEC);
+#endif
+	LOG_DBG("Staging %u, flush %u, batch %u, window %u", params.staging_buf_size,
+		params.flush_threshold, params.async_batch, params.pull_window);
+#endif
+}
+
+const struct lcz_lwm2m_sw_mgmt_params *lcz_lwm2m_sw_mgmt_params(void)
+{
+	return &params;
+}
+
+bool lcz_lwm2m_sw_mgmt_progress_due(int *last_pct, int pct)
+{
+	if (pct < *last_pct || pct >= *last_pct + (int)params.progress_step || pct == 100) {
+		*last_pct = pct;
+		return true;
+	}
+	return false;
+}
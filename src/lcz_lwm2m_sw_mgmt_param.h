@@ -0,0 +1,76 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_param.h
+ * @brief Tunable parameters of the software management module
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_PARAM_H__
+#define __LCZ_LWM2M_SW_MGMT_PARAM_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Values are clamped to what the build allocated, so they can only lower the Kconfig limits */
+struct lcz_lwm2m_sw_mgmt_params {
+	/* Percent of progress between log messages */
+	uint32_t progress_step;
+	/* File backend: staging buffer bytes used before the buffer is written to the file */
+	uint32_t staging_buf_size;
+	/* Flash backend: bytes buffered before they are written to flash */
+	uint32_t flush_threshold;
+	/* Queued blocks passed to the backend in one write */
+	uint32_t async_batch;
+	/* Block requests in flight for a pull download */
+	uint32_t pull_window;
+	/* HL7800 install delay without the scheduler */
+	uint32_t install_delay_s;
+	/* Settle time of installs that reset the connection */
+	uint32_t sched_settle_ms;
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Read the parameters from the attributes. Called when a download starts, so a change
+ * applies to the next download.
+ */
+void lcz_lwm2m_sw_mgmt_params_load(void);
+
+/**
+ * @brief Get the parameters
+ *
+ * @return const struct lcz_lwm2m_sw_mgmt_params* parameters read by the last load, or the
+ * Kconfig values without attributes
+ */
+const struct lcz_lwm2m_sw_mgmt_params *lcz_lwm2m_sw_mgmt_params(void);
+
+/**
+ * @brief Limit progress logging of the backends to every progress_step percent
+ *
+ * @param last_pct percent last logged, updated when logging is due
+ * @param pct current percent
+ * @return true if the progress should be logged
+ */
+bool lcz_lwm2m_sw_mgmt_progress_due(int *last_pct, int pct);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_PARAM_H__ */
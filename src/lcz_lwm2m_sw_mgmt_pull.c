@@ -0,0 +1,661 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_pull.c
+ * @brief Windowed CoAP pull downloader for LwM2M software management.
+ *
+ * Block 0 is fetched on its own to learn the package size (Size2) and the block size the server
+ * accepts. After that up to CONFIG_LCZ_LWM2M_SW_MGMT_PULL_WINDOW Block2 requests are kept in
+ * flight. Responses may arrive in any order; they are held in the window and delivered in order,
+ * and each delivered block frees a slot for the next request.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_pull, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/net/lwm2m.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/sys/byteorder.h>
+#include <stdlib.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#include "lcz_lwm2m_sw_mgmt_pull.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define BLOCK_SIZE CONFIG_LCZ_LWM2M_SW_MGMT_PULL_BLOCK_SIZE
+#define WINDOW CONFIG_LCZ_LWM2M_SW_MGMT_PULL_WINDOW
+#define URI_MAX_LEN CONFIG_LCZ_LWM2M_SW_MGMT_PULL_URI_MAX_LEN
+#define ACK_TIMEOUT_MS CONFIG_LCZ_LWM2M_SW_MGMT_PULL_ACK_TIMEOUT_MS
+#define MAX_RETRANSMIT CONFIG_LCZ_LWM2M_SW_MGMT_PULL_MAX_RETRANSMIT
+
+BUILD_ASSERT((BLOCK_SIZE & (BLOCK_SIZE - 1)) == 0, "Pull block size must be a power of two");
+
+#define COAP_DEFAULT_PORT "5683"
+#define COAP_SCHEME "coap://"
+
+/* Token is a per download session ID followed by the block number */
+#define TOKEN_LEN (2 * sizeof(uint32_t))
+
+/* Requests carry the URI options, responses carry a block of payload */
+#define TX_BUF_SIZE (URI_MAX_LEN + 32)
+#define RX_BUF_SIZE (BLOCK_SIZE + 64)
+
+struct pull_slot {
+	uint32_t num;
+	uint16_t msg_id;
+	/* Request is waiting for a response */
+	bool pending;
+	/* Server sent an empty ACK, the response follows separately */
+	bool acked;
+	bool received;
+	bool more;
+	uint8_t retries;
+	int64_t deadline;
+	uint16_t len;
+	uint8_t data[BLOCK_SIZE];
+};
+
+struct pull_ctx {
+	atomic_t busy;
+	atomic_t cancel;
+	uint16_t obj_inst;
+	lcz_lwm2m_sw_mgmt_pull_result_cb_t result_cb;
+	char uri[URI_MAX_LEN + 1];
+	/* Pointers into uri after it is split */
+	char *host;
+	char *port;
+	char *path;
+	char *query;
+	int sock;
+	uint32_t session;
+	/* Negotiated with block 0 */
+	uint8_t szx;
+	uint16_t block_size;
+	size_t total_size;
+	uint32_t block_count;
+	uint32_t window;
+	uint32_t next_request;
+	uint32_t next_deliver;
+	struct pull_slot slots[WINDOW];
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int parse_uri(struct pull_ctx *ctx);
+static int append_split_options(struct coap_packet *pkt, uint16_t code, const char *str,
+				const char *sep);
+static int pull_connect(struct pull_ctx *ctx);
+static int send_request(struct pull_ctx *ctx, struct pull_slot *slot, bool retransmit);
+static int send_empty_ack(struct pull_ctx *ctx, uint16_t id);
+static struct pull_slot *find_slot(struct pull_ctx *ctx, uint32_t num);
+static int handle_response(struct pull_ctx *ctx, uint8_t *buf, size_t len);
+static int fill_window(struct pull_ctx *ctx);
+static int deliver_blocks(struct pull_ctx *ctx, bool *done);
+static int check_timeouts(struct pull_ctx *ctx, int *poll_ms);
+static int pull_download(struct pull_ctx *ctx);
+static void pull_thread(void *arg1, void *arg2, void *arg3);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct pull_ctx pull;
+static K_SEM_DEFINE(pull_start_sem, 0, 1);
+static uint8_t tx_buf[TX_BUF_SIZE];
+static uint8_t rx_buf[RX_BUF_SIZE];
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+/* Split coap://host[:port]/path[?query] in place */
+static int parse_uri(struct pull_ctx *ctx)
+{
+	char *p;
+
+	if (strncmp(ctx->uri, COAP_SCHEME, strlen(COAP_SCHEME)) != 0) {
+		return -EPROTONOSUPPORT;
+	}
+
+	p = ctx->uri + strlen(COAP_SCHEME);
+	if (*p == '[') {
+		/* IPv6 literal */
+		ctx->host = ++p;
+		p = strchr(p, ']');
+		if (p == NULL) {
+			return -EINVAL;
+		}
+		*p++ = '\0';
+	} else {
+		ctx->host = p;
+		p += strcspn(p, ":/?");
+	}
+
+	ctx->port = COAP_DEFAULT_PORT;
+	if (*p == ':') {
+		*p++ = '\0';
+		ctx->port = p;
+		p += strcspn(p, "/?");
+	}
+
+	ctx->path = "";
+	ctx->query = "";
+	if (*p == '/') {
+		*p++ = '\0';
+		ctx->path = p;
+		p += strcspn(p, "?");
+	}
+	if (*p == '?') {
+		*p++ = '\0';
+		ctx->query = p;
+	}
+
+	if (*ctx->host == '\0' || *ctx->port == '\0') {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int append_split_options(struct coap_packet *pkt, uint16_t code, const char *str,
+				const char *sep)
+{
+	int ret;
+	size_t len;
+
+	while (*str != '\0') {
+		len = strcspn(str, sep);
+		if (len > 0) {
+			ret = coap_packet_append_option(pkt, code, (uint8_t *)str, len);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		str += len;
+		if (*str != '\0') {
+			str++;
+		}
+	}
+	return 0;
+}
+
+static int pull_connect(struct pull_ctx *ctx)
+{
+	int ret;
+	struct zsock_addrinfo hints = { 0 };
+	struct zsock_addrinfo *res;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	ret = zsock_getaddrinfo(ctx->host, ctx->port, &hints, &res);
+	if (ret != 0) {
+		LOG_ERR("Could not resolve %s [%d]", ctx->host, ret);
+		return -EHOSTUNREACH;
+	}
+
+	ctx->sock = zsock_socket(res->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (ctx->sock < 0) {
+		ret = -errno;
+		LOG_ERR("Could not create socket [%d]", ret);
+		goto exit;
+	}
+
+	ret = zsock_connect(ctx->sock, res->ai_addr, res->ai_addrlen);
+	if (ret < 0) {
+		ret = -errno;
+		LOG_ERR("Could not connect [%d]", ret);
+		(void)zsock_close(ctx->sock);
+		ctx->sock = -1;
+	}
+
+exit:
+	zsock_freeaddrinfo(res);
+	return ret;
+}
+
+static int send_request(struct pull_ctx *ctx, struct pull_slot *slot, bool retransmit)
+{
+	int ret;
+	struct coap_packet req;
+	uint8_t token[TOKEN_LEN];
+
+	if (!retransmit) {
+		slot->msg_id = coap_next_id();
+		slot->retries = 0;
+		slot->pending = true;
+		slot->acked = false;
+		slot->received = false;
+	}
+
+	sys_put_be32(ctx->session, &token[0]);
+	sys_put_be32(slot->num, &token[sizeof(uint32_t)]);
+
+	ret = coap_packet_init(&req, tx_buf, sizeof(tx_buf), COAP_VERSION_1, COAP_TYPE_CON,
+			       sizeof(token), token, COAP_METHOD_GET, slot->msg_id);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Options must be appended in increasing option number order */
+	ret = append_split_options(&req, COAP_OPTION_URI_PATH, ctx->path, "/");
+	if (ret < 0) {
+		return ret;
+	}
+	ret = append_split_options(&req, COAP_OPTION_URI_QUERY, ctx->query, "&");
+	if (ret < 0) {
+		return ret;
+	}
+	ret = coap_append_option_int(&req, COAP_OPTION_BLOCK2, (slot->num << 4) | ctx->szx);
+	if (ret < 0) {
+		return ret;
+	}
+	if (slot->num == 0) {
+		/* Ask the server for the package size */
+		ret = coap_append_option_int(&req, COAP_OPTION_SIZE2, 0);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	/* Exponential back-off between retransmissions */
+	slot->deadline = k_uptime_get() + ((int64_t)ACK_TIMEOUT_MS << slot->retries);
+
+	ret = zsock_send(ctx->sock, req.data, req.offset, 0);
+	return ret < 0 ? -errno : 0;
+}
+
+static int send_empty_ack(struct pull_ctx *ctx, uint16_t id)
+{
+	int ret;
+	struct coap_packet ack;
+
+	ret = coap_packet_init(&ack, tx_buf, sizeof(tx_buf), COAP_VERSION_1, COAP_TYPE_ACK, 0, NULL,
+			       COAP_CODE_EMPTY, id);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = zsock_send(ctx->sock, ack.data, ack.offset, 0);
+	return ret < 0 ? -errno : 0;
+}
+
+static struct pull_slot *find_slot(struct pull_ctx *ctx, uint32_t num)
+{
+	struct pull_slot *slot = &ctx->slots[num % WINDOW];
+
+	return (slot->num == num && (slot->pending || slot->received)) ? slot : NULL;
+}
+
+static int handle_response(struct pull_ctx *ctx, uint8_t *buf, size_t len)
+{
+	int ret;
+	int i;
+	int block2;
+	int size2;
+	uint8_t type;
+	uint8_t code;
+	uint16_t id;
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	uint32_t num;
+	uint16_t payload_len;
+	const uint8_t *payload;
+	struct coap_packet rsp;
+	struct pull_slot *slot;
+
+	ret = coap_packet_parse(&rsp, buf, len, NULL, 0);
+	if (ret < 0) {
+		LOG_WRN("Invalid CoAP message [%d]", ret);
+		return 0;
+	}
+
+	type = coap_header_get_type(&rsp);
+	code = coap_header_get_code(&rsp);
+	id = coap_header_get_id(&rsp);
+
+	if (type == COAP_TYPE_RESET) {
+		return -ECONNRESET;
+	}
+
+	if (code == COAP_CODE_EMPTY) {
+		/* Separate response will follow, stop retransmitting the request */
+		if (type == COAP_TYPE_ACK) {
+			for (i = 0; i < WINDOW; i++) {
+				if (ctx->slots[i].pending && ctx->slots[i].msg_id == id) {
+					ctx->slots[i].acked = true;
+				}
+			}
+		}
+		return 0;
+	}
+
+	if (type == COAP_TYPE_CON) {
+		ret = send_empty_ack(ctx, id);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (coap_header_get_token(&rsp, token) != TOKEN_LEN ||
+	    sys_get_be32(&token[0]) != ctx->session) {
+		/* Stale response from an earlier download */
+		return 0;
+	}
+	num = sys_get_be32(&token[sizeof(uint32_t)]);
+	slot = find_slot(ctx, num);
+	if (slot == NULL || slot->received) {
+		/* Duplicate */
+		return 0;
+	}
+
+	if (code != COAP_RESPONSE_CODE_CONTENT) {
+		LOG_ERR("Block %u failed with code %u.%02u", num, code >> 5, code & 0x1f);
+		return -EIO;
+	}
+
+	payload = coap_packet_get_payload(&rsp, &payload_len);
+	block2 = coap_get_option_int(&rsp, COAP_OPTION_BLOCK2);
+
+	if (num == 0) {
+		if (block2 < 0) {
+			/* The whole package fits in one response */
+			ctx->block_size = BLOCK_SIZE;
+			ctx->total_size = payload_len;
+			slot->more = false;
+		} else {
+			/* The server may only lower the block size */
+			ctx->szx = MIN(ctx->szx, block2 & 0x7);
+			ctx->block_size = 16 << ctx->szx;
+			size2 = coap_get_option_int(&rsp, COAP_OPTION_SIZE2);
+			if (size2 <= 0) {
+				LOG_ERR("Server did not report the package size");
+				return -EBADMSG;
+			}
+			ctx->total_size = size2;
+			slot->more = (block2 & 0x8) != 0;
+		}
+		ctx->block_count = DIV_ROUND_UP(ctx->total_size, ctx->block_size);
+		ctx->window = lcz_lwm2m_sw_mgmt_params()->pull_window;
+		LOG_INF("Pulling %zu bytes in %u blocks of %u", ctx->total_size, ctx->block_count,
+			ctx->block_size);
+	} else {
+		if (block2 < 0 || (block2 >> 4) != num || (block2 & 0x7) != ctx->szx) {
+			LOG_ERR("Unexpected Block2 for block %u", num);
+			return -EBADMSG;
+		}
+		slot->more = (block2 & 0x8) != 0;
+	}
+
+	if (payload == NULL || payload_len > ctx->block_size ||
+	    (slot->more && payload_len != ctx->block_size)) {
+		LOG_ERR("Bad payload size %u for block %u", payload_len, num);
+		return -EBADMSG;
+	}
+
+	memcpy(slot->data, payload, payload_len);
+	slot->len = payload_len;
+	slot->pending = false;
+	slot->received = true;
+	return 0;
+}
+
+static int fill_window(struct pull_ctx *ctx)
+{
+	int ret;
+	struct pull_slot *slot;
+
+	while (ctx->next_request < ctx->block_count &&
+	       ctx->next_request < ctx->next_deliver + ctx->window) {
+		slot = &ctx->slots[ctx->next_request % WINDOW];
+		slot->num = ctx->next_request;
+		ret = send_request(ctx, slot, false);
+		if (ret < 0) {
+			LOG_ERR("Could not send request [%d]", ret);
+			return ret;
+		}
+		ctx->next_request++;
+	}
+	return 0;
+}
+
+static int deliver_blocks(struct pull_ctx *ctx, bool *done)
+{
+	int ret;
+	bool last;
+	size_t offset;
+	struct pull_slot *slot;
+
+	while (!*done) {
+		slot = &ctx->slots[ctx->next_deliver % WINDOW];
+		if (!slot->received || slot->num != ctx->next_deliver) {
+			break;
+		}
+
+		offset = (size_t)slot->num * ctx->block_size;
+		last = !slot->more || offset + slot->len >= ctx->total_size;
+		if (last && offset + slot->len != ctx->total_size) {
+			LOG_ERR("Package ended at %zu, expected %zu", offset + slot->len,
+				ctx->total_size);
+			return -EBADMSG;
+		}
+
+		ret = lcz_lwm2m_sw_mgmt_write_package(ctx->obj_inst, offset, slot->data, slot->len,
+						      last, ctx->total_size);
+		if (ret < 0) {
+			LOG_ERR("Block %u rejected [%d]", slot->num, ret);
+			return ret;
+		}
+
+		slot->received = false;
+		ctx->next_deliver++;
+		*done = last || ret == LCZ_LWM2M_SW_MGMT_WRITE_CACHED;
+	}
+	return 0;
+}
+
+/* Retransmit expired requests and work out how long to wait for the next response */
+static int check_timeouts(struct pull_ctx *ctx, int *poll_ms)
+{
+	int ret;
+	int i;
+	int64_t now = k_uptime_get();
+	int64_t wait = ACK_TIMEOUT_MS << MAX_RETRANSMIT;
+	struct pull_slot *slot;
+
+	for (i = 0; i < WINDOW; i++) {
+		slot = &ctx->slots[i];
+		if (!slot->pending) {
+			continue;
+		}
+		if (slot->deadline <= now) {
+			if (slot->retries >= MAX_RETRANSMIT) {
+				LOG_ERR("Block %u timed out", slot->num);
+				return -ETIMEDOUT;
+			}
+			slot->retries++;
+			if (!slot->acked) {
+				ret = send_request(ctx, slot, true);
+				if (ret < 0) {
+					return ret;
+				}
+			} else {
+				/* Give the separate response time without resending */
+				slot->deadline = now + ((int64_t)ACK_TIMEOUT_MS << slot->retries);
+			}
+		}
+		wait = MIN(wait, slot->deadline - now);
+	}
+
+	*poll_ms = (int)MAX(wait, 0);
+	return 0;
+}
+
+static int pull_download(struct pull_ctx *ctx)
+{
+	int ret;
+	int poll_ms;
+	bool done = false;
+	struct zsock_pollfd fds;
+
+	ret = parse_uri(ctx);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = pull_connect(ctx);
+	if (ret < 0) {
+		return ret;
+	}
+
+	memset(ctx->slots, 0, sizeof(ctx->slots));
+	ctx->session = sys_rand32_get();
+	ctx->szx = find_lsb_set(BLOCK_SIZE) - 5;
+	ctx->block_size = BLOCK_SIZE;
+	/* Block 0 is fetched alone to learn the package and block sizes */
+	ctx->total_size = 0;
+	ctx->block_count = 1;
+	ctx->window = 1;
+	ctx->next_request = 0;
+	ctx->next_deliver = 0;
+
+	fds.fd = ctx->sock;
+	fds.events = ZSOCK_POLLIN;
+
+	while (!done) {
+		if (atomic_get(&ctx->cancel)) {
+			ret = -ECANCELED;
+			break;
+		}
+
+		ret = fill_window(ctx);
+		if (ret < 0) {
+			break;
+		}
+
+		ret = check_timeouts(ctx, &poll_ms);
+		if (ret < 0) {
+			break;
+		}
+
+		ret = zsock_poll(&fds, 1, poll_ms);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+		if (ret == 0) {
+			continue;
+		}
+
+		ret = zsock_recv(ctx->sock, rx_buf, sizeof(rx_buf), 0);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+
+		ret = handle_response(ctx, rx_buf, ret);
+		if (ret < 0) {
+			break;
+		}
+
+		ret = deliver_blocks(ctx, &done);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	(void)zsock_close(ctx->sock);
+	ctx->sock = -1;
+	return ret;
+}
+
+static void pull_thread(void *arg1, void *arg2, void *arg3)
+{
+	int ret;
+
+	ARG_UNUSED(arg1);
+	ARG_UNUSED(arg2);
+	ARG_UNUSED(arg3);
+
+	while (true) {
+		(void)k_sem_take(&pull_start_sem, K_FOREVER);
+
+		ret = pull_download(&pull);
+		if (ret < 0) {
+			LOG_ERR("Pull download failed [%d]", ret);
+		} else {
+			LOG_INF("Pull download complete");
+		}
+
+		/* Moves object 9 to Delivered, as a package written by the server would */
+		lcz_lwm2m_sw_mgmt_pull_end(pull.obj_inst, ret);
+		if (pull.result_cb != NULL) {
+			pull.result_cb(pull.obj_inst, ret);
+		}
+		atomic_set(&pull.busy, 0);
+	}
+}
+
+K_THREAD_DEFINE(sw_mgmt_pull, CONFIG_LCZ_LWM2M_SW_MGMT_PULL_STACK_SIZE, pull_thread, NULL, NULL,
+		NULL, CONFIG_LCZ_LWM2M_SW_MGMT_PULL_THREAD_PRIORITY, 0, 0);
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_pull_start(uint16_t obj_inst, const char *uri,
+				 lcz_lwm2m_sw_mgmt_pull_result_cb_t result_cb)
+{
+	int ret;
+	char path[LWM2M_MAX_PATH_STR_LEN];
+
+	if (uri == NULL || strlen(uri) > URI_MAX_LEN) {
+		return -EINVAL;
+	}
+
+	if (strncmp(uri, COAP_SCHEME, strlen(COAP_SCHEME)) != 0) {
+		return -EPROTONOSUPPORT;
+	}
+
+	if (!atomic_cas(&pull.busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	ret = lcz_lwm2m_sw_mgmt_pull_begin(obj_inst);
+	if (ret < 0) {
+		atomic_set(&pull.busy, 0);
+		return ret;
+	}
+
+	/* As for a server initiated pull, the Package URI identifies the package being downloaded.
+	 * If it doesn't fit, clear it rather than leave the URI of another package.
+	 */
+	snprintk(path, sizeof(path), "9/%d/3", obj_inst);
+	if (lwm2m_engine_set_string(path, (char *)uri) < 0) {
+		(void)lwm2m_engine_set_string(path, "");
+	}
+
+	/* The window is needed before the first block reaches the download pipeline */
+	lcz_lwm2m_sw_mgmt_params_load();
+	pull.obj_inst = obj_inst;
+	pull.result_cb = result_cb;
+	strcpy(pull.uri, uri);
+	atomic_set(&pull.cancel, 0);
+	k_sem_give(&pull_start_sem);
+	return 0;
+}
+
+int lcz_lwm2m_sw_mgmt_pull_cancel(void)
+{
+	if (!atomic_get(&pull.busy)) {
+		return -EALREADY;
+	}
+
+	atomic_set(&pull.cancel, 1);
+	return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_sched.c
+ * @brief Install scheduler for LwM2M software management.
+ *
+ * One install runs at a time. The next one is picked from the queued installs that are ready and
+ * whose dependency isn't queued: installs that keep the connection up first, then installs that
+ * reset it. Once a resetting install has run, the other resetting installs follow right away
+ * because the connection is down already. Ties are broken by priority, then instance number.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_sched, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "lcz_lwm2m_sw_mgmt_param.h"
+#include "lcz_lwm2m_sw_mgmt_sched.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_JOBS CONFIG_LCZ_LWM2M_SW_MGMT_MAX_INSTANCES
+#define NONE -1
+
+BUILD_ASSERT(MAX_JOBS <= 32, "Cancellation masks hold 32 instances");
+
+struct sched_job {
+	bool queued;
+	/* Uptime when the install may start */
+	int64_t ready;
+	struct lcz_lwm2m_sw_mgmt_install_desc desc;
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static bool is_reset(int job);
+static bool runs_before(int a, int b);
+static int next_job(int64_t now, int64_t *wait);
+static void sched_work_cb(struct k_work *work);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct sched_job jobs[MAX_JOBS];
+static int running = NONE;
+/* A resetting install has run and the connection hasn't been used since */
+static bool outage;
+static K_MUTEX_DEFINE(sched_lock);
+static K_WORK_DELAYABLE_DEFINE(sched_work, sched_work_cb);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static bool is_reset(int job)
+{
+	return (jobs[job].desc.flags & LCZ_LWM2M_SW_MGMT_INSTALL_RESET) != 0;
+}
+
+static bool runs_before(int a, int b)
+{
+	if (is_reset(a) != is_reset(b)) {
+		return outage ? is_reset(a) : is_reset(b);
+	}
+	if (jobs[a].desc.priority != jobs[b].desc.priority) {
+		return jobs[a].desc.priority < jobs[b].desc.priority;
+	}
+	return a < b;
+}
+
+/* Returns NONE if nothing can start now, wait is set when a queued install becomes ready later */
+static int next_job(int64_t now, int64_t *wait)
+{
+	int best = NONE;
+	int after;
+	int i;
+
+	*wait = -1;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (!jobs[i].queued) {
+			continue;
+		}
+		after = jobs[i].desc.after;
+		if (after >= 0 && after < MAX_JOBS && jobs[after].queued) {
+			continue;
+		}
+		/* The connection is already down, there is nothing to wait for */
+		if (jobs[i].ready > now && !(outage && is_reset(i))) {
+			if (*wait < 0 || jobs[i].ready - now < *wait) {
+				*wait = jobs[i].ready - now;
+			}
+			continue;
+		}
+		if (best == NONE || runs_before(i, best)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+static void sched_work_cb(struct k_work *work)
+{
+	struct lcz_lwm2m_sw_mgmt_install_desc desc;
+	uint32_t stuck = 0;
+	int64_t wait;
+	int job;
+	int i;
+
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&sched_lock, K_FOREVER);
+	if (running != NONE) {
+		k_mutex_unlock(&sched_lock);
+		return;
+	}
+
+	job = next_job(k_uptime_get(), &wait);
+	if (job == NONE) {
+		if (wait >= 0) {
+			(void)k_work_reschedule(&sched_work, K_MSEC(wait));
+		} else {
+			outage = false;
+			/* Whatever is left waits on a loop. All of it is dequeued before the
+			 * completions, so none of them is reported twice by a cancellation.
+			 */
+			for (i = 0; i < MAX_JOBS; i++) {
+				if (jobs[i].queued) {
+					jobs[i].queued = false;
+					stuck |= BIT(i);
+				}
+			}
+		}
+		k_mutex_unlock(&sched_lock);
+		for (i = 0; i < MAX_JOBS; i++) {
+			if (stuck & BIT(i)) {
+				LOG_ERR("Install dependency loop at instance %d", i);
+				(void)lcz_lwm2m_sw_mgmt_install_completed(i, -EDEADLK);
+			}
+		}
+		return;
+	}
+
+	jobs[job].queued = false;
+	running = job;
+	if (is_reset(job)) {
+		outage = true;
+	}
+	desc = jobs[job].desc;
+	k_mutex_unlock(&sched_lock);
+
+	LOG_INF("Starting install of instance %d", job);
+	desc.start(job);
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_lwm2m_sw_mgmt_schedule_install(uint16_t obj_inst,
+				       const struct lcz_lwm2m_sw_mgmt_install_desc *desc)
+{
+	int ret = 0;
+
+	if (obj_inst >= MAX_JOBS || desc == NULL || desc->start == NULL ||
+	    desc->after == obj_inst) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&sched_lock, K_FOREVER);
+	if (jobs[obj_inst].queued || running == obj_inst) {
+		ret = -EALREADY;
+		goto exit;
+	}
+
+	jobs[obj_inst].desc = *desc;
+	jobs[obj_inst].ready = k_uptime_get();
+	if (desc->flags & LCZ_LWM2M_SW_MGMT_INSTALL_RESET) {
+		jobs[obj_inst].ready += lcz_lwm2m_sw_mgmt_params()->sched_settle_ms;
+	}
+	jobs[obj_inst].queued = true;
+	LOG_INF("Install of instance %d queued", obj_inst);
+
+	/* The work re-arms itself for installs that aren't ready yet */
+	(void)k_work_reschedule(&sched_work, K_NO_WAIT);
+
+exit:
+	k_mutex_unlock(&sched_lock);
+	return ret;
+}
+
+void lcz_lwm2m_sw_mgmt_sched_completed(uint16_t obj_inst, int result)
+{
+	bool tracked = false;
+	uint32_t cancel = 0;
+	int i;
+
+	if (obj_inst >= MAX_JOBS) {
+		return;
+	}
+
+	k_mutex_lock(&sched_lock, K_FOREVER);
+	if (running == obj_inst) {
+		running = NONE;
+		tracked = true;
+	} else if (jobs[obj_inst].queued) {
+		/* Completed without being started, e.g. a failed dependency */
+		jobs[obj_inst].queued = false;
+		tracked = true;
+	}
+	/* Installs that depend on a failed one can't run */
+	for (i = 0; tracked && result < 0 && i < MAX_JOBS; i++) {
+		if (jobs[i].queued && jobs[i].desc.after == obj_inst) {
+			cancel |= BIT(i);
+		}
+	}
+	k_mutex_unlock(&sched_lock);
+
+	if (!tracked) {
+		return;
+	}
+
+	/* Each cancellation cascades to its own dependents */
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (cancel & BIT(i)) {
+			LOG_WRN("Install of instance %d cancelled, instance %d failed", i,
+				obj_inst);
+			(void)lcz_lwm2m_sw_mgmt_install_completed(i, -ECANCELED);
+		}
+	}
+
+	(void)k_work_reschedule(&sched_work, K_NO_WAIT);
+}
@@ -0,0 +1,227 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_shell.c
+ * @brief Shell commands for LwM2M software management
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lcz_lwm2m_sw_mgmt_shell, CONFIG_LCZ_LWM2M_SW_MANAGEMENT_LOG_LEVEL);
+
+#include <zephyr/zephyr.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+#include "lcz_lwm2m_sw_mgmt_pull.h"
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+#include "lcz_lwm2m_sw_mgmt_file.h"
+#endif
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+static void print_stats(const struct shell *shell, uint16_t obj_inst,
+			const struct lcz_lwm2m_sw_mgmt_stats *stats);
+static int cmd_stats(const struct shell *shell, size_t argc, char **argv);
+static int cmd_stats_reset(const struct shell *shell, size_t argc, char **argv);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+static void pull_result(uint16_t obj_inst, int result);
+static int cmd_pull(const struct shell *shell, size_t argc, char **argv);
+static int cmd_pull_cancel(const struct shell *shell, size_t argc, char **argv);
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+static int cmd_slots(const struct shell *shell, size_t argc, char **argv);
+static int cmd_slot_select(const struct shell *shell, size_t argc, char **argv);
+#endif
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+static void print_stats(const struct shell *shell, uint16_t obj_inst,
+			const struct lcz_lwm2m_sw_mgmt_stats *stats)
+{
+	int i;
+
+	shell_print(shell, "Instance %d", obj_inst);
+	shell_print(shell, "  downloads: %u installs: %u", stats->downloads, stats->installs);
+	shell_print(shell, "  download: %u bytes %u blocks %u ms %u B/s", stats->bytes_received,
+		    stats->blocks_received, stats->download_time_ms, stats->download_rate);
+	shell_print(shell, "  block time: avg %u us max %u us",
+		    (uint32_t)(stats->blocks_total ?
+				       stats->block_time_total_us / stats->blocks_total :
+				       0),
+		    stats->block_time_max_us);
+	for (i = 0; i < LCZ_LWM2M_SW_MGMT_STATS_HIST_BINS; i++) {
+		if (i < LCZ_LWM2M_SW_MGMT_STATS_HIST_BINS - 1) {
+			shell_print(shell, "    < %6u us: %u", 128 << i, stats->block_time_hist[i]);
+		} else {
+			shell_print(shell, "    >=%6u us: %u", 128 << (i - 1),
+				    stats->block_time_hist[i]);
+		}
+	}
+	shell_print(shell, "  storage writes: %u avg %u us max %u us", stats->storage_writes,
+		    (uint32_t)(stats->storage_writes ?
+				       stats->storage_write_total_us / stats->storage_writes :
+				       0),
+		    stats->storage_write_max_us);
+	shell_print(shell, "  install: %u bytes %u ms %u B/s", stats->install_bytes,
+		    stats->install_time_ms, stats->install_rate);
+	shell_print(shell, "  failures: download %u verify %u storage %u install %u rejected %u",
+		    stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_DOWNLOAD],
+		    stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_VERIFY],
+		    stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_STORAGE],
+		    stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_INSTALL],
+		    stats->failures[LCZ_LWM2M_SW_MGMT_FAILURE_REJECTED]);
+}
+
+static int cmd_stats(const struct shell *shell, size_t argc, char **argv)
+{
+	struct lcz_lwm2m_sw_mgmt_stats stats;
+	uint16_t obj_inst;
+	uint16_t first;
+	uint16_t last;
+	bool found = false;
+
+	if (argc > 1) {
+		first = (uint16_t)strtoul(argv[1], NULL, 0);
+		last = first;
+	} else {
+		first = 0;
+		last = CONFIG_LCZ_LWM2M_SW_MGMT_MAX_INSTANCES - 1;
+	}
+
+	for (obj_inst = first; obj_inst <= last; obj_inst++) {
+		if (lcz_lwm2m_sw_mgmt_get_stats(obj_inst, &stats) == 0) {
+			print_stats(shell, obj_inst, &stats);
+			found = true;
+		}
+	}
+
+	if (!found) {
+		shell_error(shell, "No software management instance");
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int cmd_stats_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	int ret;
+
+	ret = lcz_lwm2m_sw_mgmt_reset_stats((uint16_t)strtoul(argv[1], NULL, 0));
+	if (ret < 0) {
+		shell_error(shell, "Reset failed [%d]", ret);
+	}
+	return ret;
+}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+static void pull_result(uint16_t obj_inst, int result)
+{
+	/* Called from the pull thread after the command has returned, so there is no shell */
+	if (result < 0) {
+		LOG_ERR("Pull for instance %d failed [%d]", obj_inst, result);
+	} else {
+		LOG_INF("Pull for instance %d complete", obj_inst);
+	}
+}
+
+static int cmd_pull(const struct shell *shell, size_t argc, char **argv)
+{
+	int ret;
+
+	ret = lcz_lwm2m_sw_mgmt_pull_start((uint16_t)strtoul(argv[1], NULL, 0), argv[2],
+					   pull_result);
+	if (ret < 0) {
+		shell_error(shell, "Pull failed to start [%d]", ret);
+	}
+	return ret;
+}
+
+static int cmd_pull_cancel(const struct shell *shell, size_t argc, char **argv)
+{
+	int ret;
+
+	ret = lcz_lwm2m_sw_mgmt_pull_cancel();
+	if (ret < 0) {
+		shell_error(shell, "No pull running [%d]", ret);
+	}
+	return ret;
+}
+#endif
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+static int cmd_slots(const struct shell *shell, size_t argc, char **argv)
+{
+	static const char *const state_str[] = { "empty", "downloading", "downloaded",
+						 "installing", "good" };
+	struct lcz_lwm2m_sw_mgmt_file *file;
+	struct lcz_lwm2m_sw_mgmt_file_slot_info info;
+	uint8_t slot;
+
+	file = lcz_lwm2m_sw_mgmt_file_find((uint16_t)strtoul(argv[1], NULL, 0));
+	if (file == NULL) {
+		shell_error(shell, "No staging slots for instance");
+		return -ENOENT;
+	}
+
+	for (slot = 0; lcz_lwm2m_sw_mgmt_file_slot_info(file, slot, &info) == 0; slot++) {
+		shell_print(shell, "%c: %-11s %u bytes%s%s", 'a' + slot, state_str[info.state],
+			    info.size, info.write ? " [write]" : "",
+			    info.install ? " [install]" : "");
+	}
+	return 0;
+}
+
+static int cmd_slot_select(const struct shell *shell, size_t argc, char **argv)
+{
+	int ret;
+	struct lcz_lwm2m_sw_mgmt_file *file;
+
+	file = lcz_lwm2m_sw_mgmt_file_find((uint16_t)strtoul(argv[1], NULL, 0));
+	if (file == NULL) {
+		shell_error(shell, "No staging slots for instance");
+		return -ENOENT;
+	}
+
+	ret = lcz_lwm2m_sw_mgmt_file_select_slot(file, (uint8_t)(argv[2][0] - 'a'));
+	if (ret < 0) {
+		shell_error(shell, "Select failed [%d]", ret);
+	}
+	return ret;
+}
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_sw_mgmt,
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_STATS)
+	SHELL_CMD_ARG(stats, NULL, "Show statistics [instance]", cmd_stats, 1, 1),
+	SHELL_CMD_ARG(stats_reset, NULL, "Clear statistics <instance>", cmd_stats_reset, 2, 0),
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_PULL)
+	SHELL_CMD_ARG(pull, NULL, "Download a package <instance> <coap://uri>", cmd_pull, 3, 0),
+	SHELL_CMD(pull_cancel, NULL, "Stop the running pull download", cmd_pull_cancel),
+#endif
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_FILE_AB)
+	SHELL_CMD_ARG(slots, NULL, "Show staging slots <instance>", cmd_slots, 2, 0),
+	SHELL_CMD_ARG(slot_select, NULL, "Install from a slot next <instance> <a|b>",
+		      cmd_slot_select, 3, 0),
+#endif
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(sw_mgmt, &sub_sw_mgmt, "LwM2M software management", NULL);
@@ -0,0 +1,65 @@
+/**
+ * @file lcz_lwm2m_sw_mgmt_trace.h
+ * @brief Update lifecycle trace events
+ *
+ * Events are emitted as tracing named events: an "swm_" prefixed name, the object instance and one
+ * argument. The tracing backend adds the timestamp. Negative results are passed as their two's
+ * complement.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LCZ_LWM2M_SW_MGMT_TRACE_H__
+#define __LCZ_LWM2M_SW_MGMT_TRACE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TRACE)
+#include <zephyr/tracing/tracing.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_TRACE)
+#define SW_MGMT_TRACE(name, obj_inst, arg)                                                         \
+	sys_trace_named_event("swm_" name, (uint32_t)(obj_inst), (uint32_t)(arg))
+#else
+#define SW_MGMT_TRACE(name, obj_inst, arg)                                                         \
+	do {                                                                                       \
+	} while (false)
+#endif
+
+/* Package block received from the server, arg is its offset in the package */
+#define SW_MGMT_TRACE_BLOCK(obj_inst, offset) SW_MGMT_TRACE("block", obj_inst, offset)
+/* Last block of the package handled, arg is the result */
+#define SW_MGMT_TRACE_DOWNLOAD_DONE(obj_inst, result)                                              \
+	SW_MGMT_TRACE("download_done", obj_inst, result)
+/* A backend starts writing to storage, arg is the number of bytes */
+#define SW_MGMT_TRACE_WRITE_START(obj_inst, len) SW_MGMT_TRACE("write_start", obj_inst, len)
+/* The storage write finished, arg is the result */
+#define SW_MGMT_TRACE_WRITE_END(obj_inst, result) SW_MGMT_TRACE("write_end", obj_inst, result)
+/* Install resource executed */
+#define SW_MGMT_TRACE_INSTALL(obj_inst) SW_MGMT_TRACE("install", obj_inst, 0)
+/* A backend starts the install after its delay, arg is the package size */
+#define SW_MGMT_TRACE_INSTALL_START(obj_inst, size) SW_MGMT_TRACE("install_start", obj_inst, size)
+/* Modem install progress, arg is the bytes transferred */
+#define SW_MGMT_TRACE_FOTA_COUNT(obj_inst, count) SW_MGMT_TRACE("fota_count", obj_inst, count)
+/* Modem install state change, arg is the new state */
+#define SW_MGMT_TRACE_FOTA_STATE(obj_inst, state) SW_MGMT_TRACE("fota_state", obj_inst, state)
+/* Install completed, arg is the result */
+#define SW_MGMT_TRACE_COMPLETE(obj_inst, result) SW_MGMT_TRACE("complete", obj_inst, result)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_LWM2M_SW_MGMT_TRACE_H__ */
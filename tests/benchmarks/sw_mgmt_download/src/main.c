@@ -0,0 +1,315 @@
+/**
+ * @file main.c
+ * @brief Benchmark of the download path (write callback to backend), of the execute event
+ * fan-out and of the event callback lock
+ *
+ * Results are printed as one JSON object per line, prefixed with "BENCH ", so they can be
+ * collected from the twister handler log.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/ztest.h>
+#include <file_system_utilities.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "mock_lwm2m.h"
+#include "test_clock.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+/* Instance whose backend only counts the bytes it is given */
+#define SINK_OBJ_INST 1
+#define HL7800_OBJ_INST CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST
+#define HL7800_FILE_PATH CONFIG_FSU_MOUNT_POINT "/" CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_FILE_NAME
+
+#define PACKAGE_SIZE (64 * 1024)
+#define MIN_BLOCK_SIZE 16
+#define MAX_BLOCK_SIZE 1024
+#define MAX_AGENTS 64
+#define EXECUTES 200
+#define CONTENTION_ROUNDS 50
+
+#define CONTENDER_STACK_SIZE 1024
+/* Runs as soon as the lock holder lets it, so it is blocked on the lock for the whole hold */
+#define CONTENDER_PRIORITY (CONFIG_ZTEST_THREAD_PRIORITY - 1)
+
+#if defined(CONFIG_LCZ_LWM2M_SW_MGMT_ASYNC_DOWNLOAD)
+#define ASYNC 1
+#else
+#define ASYNC 0
+#endif
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int sink_event(lcz_lwm2m_sw_mgmt_event_t event);
+static void *sink_read_ver(void);
+static int sink_download(uint8_t *data, uint16_t data_len, bool last_block, size_t total_size);
+static int agent_event(lcz_lwm2m_sw_mgmt_event_t event);
+static void contender_thread(void *arg1, void *arg2, void *arg3);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static uint8_t package[PACKAGE_SIZE];
+static size_t sink_bytes;
+static char sink_version[] = "1.0.0";
+
+static struct lcz_lwm2m_sw_mgmt_event_callback_agent sink_agent = {
+	.event_callback = sink_event,
+	.read_ver_callback = sink_read_ver,
+	.download_data_callback = sink_download,
+};
+static struct lcz_lwm2m_sw_mgmt_event_callback_agent agents[MAX_AGENTS - 1];
+static struct lcz_lwm2m_sw_mgmt_event_callback_agent contender_agent = {
+	.event_callback = agent_event,
+};
+
+/* Callbacks of the current execute and the time its dispatch started and ended */
+static int agent_count;
+static int agent_calls;
+static uint64_t dispatch_start;
+static uint64_t dispatch_end;
+
+static bool contend;
+static uint64_t contender_wait;
+static K_SEM_DEFINE(contender_go, 0, 1);
+static K_SEM_DEFINE(contender_done, 0, 1);
+K_THREAD_DEFINE(contender, CONTENDER_STACK_SIZE, contender_thread, NULL, NULL, NULL,
+		CONTENDER_PRIORITY, 0, 0);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void dispatch_called(void)
+{
+	agent_calls++;
+	if (agent_calls == 1) {
+		dispatch_start = test_clock_ns();
+		if (contend) {
+			k_sem_give(&contender_go);
+			k_yield();
+		}
+	}
+	if (agent_calls == agent_count) {
+		dispatch_end = test_clock_ns();
+	}
+}
+
+static int sink_event(lcz_lwm2m_sw_mgmt_event_t event)
+{
+	ARG_UNUSED(event);
+
+	dispatch_called();
+	return 0;
+}
+
+static void *sink_read_ver(void)
+{
+	return sink_version;
+}
+
+static int sink_download(uint8_t *data, uint16_t data_len, bool last_block, size_t total_size)
+{
+	ARG_UNUSED(data);
+	ARG_UNUSED(last_block);
+	ARG_UNUSED(total_size);
+
+	sink_bytes += data_len;
+	return 0;
+}
+
+static int agent_event(lcz_lwm2m_sw_mgmt_event_t event)
+{
+	ARG_UNUSED(event);
+
+	dispatch_called();
+	return 0;
+}
+
+/* Registers an agent while the dispatch holds the callback lock */
+static void contender_thread(void *arg1, void *arg2, void *arg3)
+{
+	uint64_t start;
+
+	ARG_UNUSED(arg1);
+	ARG_UNUSED(arg2);
+	ARG_UNUSED(arg3);
+
+	while (true) {
+		k_sem_take(&contender_go, K_FOREVER);
+		start = test_clock_ns();
+		(void)lcz_lwm2m_sw_mgmt_register_event_callback(SINK_OBJ_INST, &contender_agent);
+		contender_wait = test_clock_ns() - start;
+		(void)lcz_lwm2m_sw_mgmt_unregister_event_callback(SINK_OBJ_INST, &contender_agent);
+		k_sem_give(&contender_done);
+	}
+}
+
+/* Downloads the package in blocks of block_size, returns the time taken */
+static uint64_t download(uint16_t obj_inst, size_t block_size)
+{
+	uint64_t start;
+	size_t offset;
+	size_t len;
+	int ret;
+
+	start = test_clock_ns();
+	for (offset = 0; offset < PACKAGE_SIZE; offset += len) {
+		len = MIN(block_size, PACKAGE_SIZE - offset);
+		ret = mock_lwm2m_write_package(obj_inst, &package[offset], len,
+					       offset + len == PACKAGE_SIZE, PACKAGE_SIZE);
+		zassert_equal(ret, 0, "Block at %u [%d]", (uint32_t)offset, ret);
+	}
+	return test_clock_ns() - start;
+}
+
+static void report_download(const char *backend, size_t block_size, uint64_t elapsed)
+{
+	uint32_t blocks = DIV_ROUND_UP(PACKAGE_SIZE, block_size);
+
+	printk("BENCH {\"test\":\"download\",\"backend\":\"%s\",\"async\":%d,"
+	       "\"block_size\":%u,\"blocks\":%u,\"ns_per_block\":%u,\"bytes_per_s\":%u}\n",
+	       backend, ASYNC, (uint32_t)block_size, blocks, (uint32_t)(elapsed / blocks),
+	       (uint32_t)(((uint64_t)PACKAGE_SIZE * NSEC_PER_SEC) / MAX(elapsed, 1)));
+}
+
+/* Sets the number of agents of the sink instance, the creator's agent included */
+static void set_agent_count(int count)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(agents); i++) {
+		(void)lcz_lwm2m_sw_mgmt_unregister_event_callback(SINK_OBJ_INST, &agents[i]);
+	}
+	for (i = 0; i < count - 1; i++) {
+		agents[i].event_callback = agent_event;
+		zassert_ok(lcz_lwm2m_sw_mgmt_register_event_callback(SINK_OBJ_INST, &agents[i]),
+			   "Register agent %d", i);
+	}
+	agent_count = count;
+}
+
+static void execute(void)
+{
+	agent_calls = 0;
+	zassert_ok(mock_lwm2m_execute(SINK_OBJ_INST, MOCK_LWM2M_RES_ACTIVATE), "Execute");
+	zassert_equal(agent_calls, agent_count, "%d of %d agents called", agent_calls,
+		      agent_count);
+}
+
+static void *sw_mgmt_download_setup(void)
+{
+	int i;
+
+	for (i = 0; i < PACKAGE_SIZE; i++) {
+		package[i] = (uint8_t)(i * 31 + (i >> 8));
+	}
+
+	zassert_ok(lcz_lwm2m_sw_mgmt_create_inst(SINK_OBJ_INST, &sink_agent), "Create sink");
+	return NULL;
+}
+
+static void sw_mgmt_download_after(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	set_agent_count(1);
+}
+
+/**************************************************************************************************/
+/* Tests                                                                                          */
+/**************************************************************************************************/
+ZTEST(sw_mgmt_download, test_block_size)
+{
+	size_t block_size;
+	uint64_t elapsed;
+
+	for (block_size = MIN_BLOCK_SIZE; block_size <= MAX_BLOCK_SIZE; block_size *= 2) {
+		sink_bytes = 0;
+		elapsed = download(SINK_OBJ_INST, block_size);
+		zassert_equal(sink_bytes, PACKAGE_SIZE, "Sink got %u bytes", (uint32_t)sink_bytes);
+		report_download("sink", block_size, elapsed);
+
+		elapsed = download(HL7800_OBJ_INST, block_size);
+		zassert_equal(fsu_get_file_size_abs(HL7800_FILE_PATH), PACKAGE_SIZE,
+			      "Staged file size");
+		report_download("hl7800", block_size, elapsed);
+	}
+}
+
+ZTEST(sw_mgmt_download, test_fan_out)
+{
+	int count;
+	int i;
+	uint64_t start;
+	uint64_t elapsed;
+
+	for (count = 1; count <= MAX_AGENTS; count *= 2) {
+		set_agent_count(count);
+
+		start = test_clock_ns();
+		for (i = 0; i < EXECUTES; i++) {
+			execute();
+		}
+		elapsed = test_clock_ns() - start;
+
+		printk("BENCH {\"test\":\"fan_out\",\"agents\":%d,\"executes\":%d,"
+		       "\"ns_per_execute\":%u,\"ns_per_agent\":%u}\n",
+		       count, EXECUTES, (uint32_t)(elapsed / EXECUTES),
+		       (uint32_t)(elapsed / ((uint64_t)EXECUTES * count)));
+	}
+}
+
+ZTEST(sw_mgmt_download, test_cb_lock)
+{
+	int i;
+	uint64_t start;
+	uint64_t hold;
+	uint64_t hold_total = 0;
+	uint64_t hold_max = 0;
+	uint64_t wait_total = 0;
+	uint64_t wait_max = 0;
+	uint64_t uncontended;
+
+	set_agent_count(MAX_AGENTS);
+
+	/* Register and unregister without a dispatch in progress */
+	start = test_clock_ns();
+	for (i = 0; i < CONTENTION_ROUNDS; i++) {
+		(void)lcz_lwm2m_sw_mgmt_register_event_callback(SINK_OBJ_INST, &contender_agent);
+		(void)lcz_lwm2m_sw_mgmt_unregister_event_callback(SINK_OBJ_INST, &contender_agent);
+	}
+	uncontended = (test_clock_ns() - start) / (2 * CONTENTION_ROUNDS);
+
+	contend = true;
+	for (i = 0; i < CONTENTION_ROUNDS; i++) {
+		execute();
+		zassert_ok(k_sem_take(&contender_done, K_SECONDS(1)), "Contender stuck");
+
+		hold = dispatch_end - dispatch_start;
+		hold_total += hold;
+		hold_max = MAX(hold_max, hold);
+		wait_total += contender_wait;
+		wait_max = MAX(wait_max, contender_wait);
+	}
+	contend = false;
+
+	printk("BENCH {\"test\":\"cb_lock\",\"agents\":%d,\"rounds\":%d,"
+	       "\"hold_avg_ns\":%u,\"hold_max_ns\":%u,\"wait_avg_ns\":%u,\"wait_max_ns\":%u,"
+	       "\"uncontended_ns\":%u}\n",
+	       MAX_AGENTS, CONTENTION_ROUNDS, (uint32_t)(hold_total / CONTENTION_ROUNDS),
+	       (uint32_t)hold_max, (uint32_t)(wait_total / CONTENTION_ROUNDS),
+	       (uint32_t)wait_max, (uint32_t)uncontended);
+}
+
+ZTEST_SUITE(sw_mgmt_download, NULL, sw_mgmt_download_setup, NULL, sw_mgmt_download_after,
+	    NULL);
@@ -0,0 +1,19 @@
+#
+# Copyright (c) 2022 Laird Connectivity LLC
+#
+# SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+#
+# Mocks the module is built against in the tests. Include after find_package(Zephyr).
+#
+
+set(SW_MGMT_TEST_COMMON_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+# The module library includes the mock headers too
+zephyr_include_directories(${SW_MGMT_TEST_COMMON_DIR}/include)
+
+target_sources(app PRIVATE
+  ${SW_MGMT_TEST_COMMON_DIR}/src/mock_lwm2m.c
+  ${SW_MGMT_TEST_COMMON_DIR}/src/mock_fsu.c
+  ${SW_MGMT_TEST_COMMON_DIR}/src/ram_fs.c
+  ${SW_MGMT_TEST_COMMON_DIR}/src/emul_hl7800.c
+  ${SW_MGMT_TEST_COMMON_DIR}/src/test_clock.c)
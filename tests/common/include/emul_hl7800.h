@@ -0,0 +1,87 @@
+/**
+ * @file emul_hl7800.h
+ * @brief Emulation of the HL7800 driver functions used by the module. An update file is read
+ * at the UART rate and reported with the same FOTA events as the driver.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __EMUL_HL7800_H__
+#define __EMUL_HL7800_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+typedef enum emul_hl7800_fault {
+	EMUL_HL7800_FAULT_NONE = 0,
+	/* mdm_hl7800_update_fw() fails with -EIO */
+	EMUL_HL7800_FAULT_UPDATE,
+	/* The modem rejects the file once it has been transferred */
+	EMUL_HL7800_FAULT_FILE,
+} emul_hl7800_fault_t;
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Make the next update fail
+ *
+ * @param fault how the next mdm_hl7800_update_fw() call fails
+ */
+void emul_hl7800_inject_fault(emul_hl7800_fault_t fault);
+
+/**
+ * @brief Set the UART rate an update file is transferred at
+ *
+ * @param rate baud rate, 0 for CONFIG_SW_MGMT_TEST_HL7800_BAUD
+ */
+void emul_hl7800_set_baud(uint32_t rate);
+
+/**
+ * @brief Set the firmware version the modem reports after the next completed update
+ *
+ * @param version version string, copied
+ */
+void emul_hl7800_set_update_version(const char *version);
+
+/**
+ * @brief Check if an update is in progress
+ *
+ * @return true from a successful mdm_hl7800_update_fw() call until the update ends
+ */
+bool emul_hl7800_busy(void);
+
+/**
+ * @brief Get the number of updates the modem completed
+ *
+ * @return int completed updates
+ */
+int emul_hl7800_update_count(void);
+
+/**
+ * @brief Get the image installed by the last completed update
+ *
+ * @param size set to the image size, may be NULL
+ * @return uint32_t CRC32 (IEEE) of the image
+ */
+uint32_t emul_hl7800_image_crc(size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EMUL_HL7800_H__ */
@@ -0,0 +1,42 @@
+/**
+ * @file file_system_utilities.h
+ * @brief File system utilities used by the module, implemented on the Zephyr file system API
+ * for the tests
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __FILE_SYSTEM_UTILITIES_H__
+#define __FILE_SYSTEM_UTILITIES_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+ssize_t fsu_get_file_size_abs(const char *abs_path);
+
+int fsu_delete_abs(const char *abs_path);
+
+ssize_t fsu_append_abs(const char *abs_path, void *data, size_t size);
+
+ssize_t fsu_write_abs(const char *abs_path, void *data, size_t size);
+
+ssize_t fsu_read_abs(const char *abs_path, void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FILE_SYSTEM_UTILITIES_H__ */
@@ -0,0 +1,40 @@
+/**
+ * @file lwm2m_engine.h
+ * @brief Parts of the LwM2M engine internal header used by the module, for the mock engine
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __LWM2M_ENGINE_H__
+#define __LWM2M_ENGINE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/net/lwm2m.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+struct lwm2m_engine_obj_inst;
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+int lwm2m_create_obj_inst(uint16_t obj_id, uint16_t obj_inst_id,
+			  struct lwm2m_engine_obj_inst **obj_inst);
+
+int lwm2m_delete_obj_inst(uint16_t obj_id, uint16_t obj_inst_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LWM2M_ENGINE_H__ */
@@ -0,0 +1,82 @@
+/**
+ * @file mock_lwm2m.h
+ * @brief Mock of the LwM2M engine parts used by the module. Resources are kept in a table
+ * keyed by path and object 9 callbacks are called directly by the test.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __MOCK_LWM2M_H__
+#define __MOCK_LWM2M_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Executable resources of object 9 */
+#define MOCK_LWM2M_RES_INSTALL 4
+#define MOCK_LWM2M_RES_UNINSTALL 6
+#define MOCK_LWM2M_RES_ACTIVATE 10
+#define MOCK_LWM2M_RES_DEACTIVATE 11
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Write a block to the Package resource, like the engine does for a block transfer
+ *
+ * @param obj_inst instance of object 9
+ * @param data block data
+ * @param data_len size of data
+ * @param last_block true for the last block of the package
+ * @param total_size size of the package
+ * @return int result of the write callback, -ENOENT if none is registered
+ */
+int mock_lwm2m_write_package(uint16_t obj_inst, uint8_t *data, uint16_t data_len,
+			     bool last_block, size_t total_size);
+
+/**
+ * @brief Execute a resource of object 9
+ *
+ * @param obj_inst instance of object 9
+ * @param res_id one of the MOCK_LWM2M_RES_ values
+ * @return int result of the execute callback, -ENOENT if none is registered
+ */
+int mock_lwm2m_execute(uint16_t obj_inst, uint16_t res_id);
+
+/**
+ * @brief Read a resource last set through the engine API
+ *
+ * @param path resource path, e.g. "9/0/7"
+ * @param value set to the value
+ * @return int 0 on success, -ENOENT if the resource was never set
+ */
+int mock_lwm2m_get_u8(const char *path, uint8_t *value);
+
+/**
+ * @brief Get the install completions reported to the engine for an instance
+ *
+ * @param obj_inst instance of object 9
+ * @param last_result set to the error code of the last completion, may be NULL
+ * @return int number of completions since the instance was created
+ */
+int mock_lwm2m_install_completions(uint16_t obj_inst, int *last_result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MOCK_LWM2M_H__ */
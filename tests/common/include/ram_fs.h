@@ -0,0 +1,113 @@
+/**
+ * @file ram_fs.h
+ * @brief File system kept in RAM, mounted at CONFIG_FSU_MOUNT_POINT for the tests. Operations
+ * can be made to fail or to take time, and the capacity can be reduced.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __RAM_FS_H__
+#define __RAM_FS_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Operations that faults can be injected into */
+enum ram_fs_op {
+	RAM_FS_OP_OPEN = 0,
+	RAM_FS_OP_READ,
+	RAM_FS_OP_WRITE,
+	RAM_FS_OP_TRUNCATE,
+	RAM_FS_OP_CLOSE,
+	RAM_FS_OP_UNLINK,
+	RAM_FS_OP_RENAME,
+	RAM_FS_OP_STAT,
+	RAM_FS_OP_STATVFS,
+	RAM_FS_OP_COUNT
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Delete every file
+ */
+void ram_fs_format(void);
+
+/**
+ * @brief Make calls of an operation fail
+ *
+ * Replaces an earlier fault of the same operation. A failed write or truncate leaves the file
+ * unchanged, a failed close still closes the file.
+ *
+ * @param op operation
+ * @param skip number of calls that succeed first
+ * @param count number of calls that fail after those, -1 for all of them
+ * @param error negative error code returned by the failing calls
+ */
+void ram_fs_inject_error(enum ram_fs_op op, int skip, int count, int error);
+
+/**
+ * @brief Make every call of an operation take time
+ *
+ * @param op operation
+ * @param latency_us time (in microseconds) the calling thread sleeps before the operation
+ */
+void ram_fs_set_latency(enum ram_fs_op op, uint32_t latency_us);
+
+/**
+ * @brief Limit the bytes all files together can hold
+ *
+ * Writes that would exceed the capacity fail with -ENOSPC and the free space reported by
+ * fs_statvfs() is reduced to match.
+ *
+ * @param bytes capacity in bytes, 0 for CONFIG_SW_MGMT_TEST_RAM_FS_SIZE
+ */
+void ram_fs_set_capacity(size_t bytes);
+
+/**
+ * @brief Remove injected errors and latencies and restore the capacity
+ */
+void ram_fs_reset_faults(void);
+
+/**
+ * @brief Get the number of calls of an operation, failed ones included
+ *
+ * @param op operation
+ * @return uint32_t calls since the last ram_fs_reset_faults()
+ */
+uint32_t ram_fs_calls(enum ram_fs_op op);
+
+/**
+ * @brief Get the number of files that are open
+ *
+ * @return int open files
+ */
+int ram_fs_open_files(void);
+
+/**
+ * @brief Get the number of files that exist
+ *
+ * @return int files
+ */
+int ram_fs_file_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RAM_FS_H__ */
@@ -0,0 +1,41 @@
+/**
+ * @file test_clock.h
+ * @brief Clock for timing code in the tests
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+#ifndef __TEST_CLOCK_H__
+#define __TEST_CLOCK_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+
+/**
+ * @brief Get the time spent running code
+ *
+ * On native_posix this is the host monotonic clock, because simulated time only moves while the
+ * CPU idles. Elsewhere it is the cycle counter.
+ *
+ * @return uint64_t time in nanoseconds
+ */
+uint64_t test_clock_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TEST_CLOCK_H__ */
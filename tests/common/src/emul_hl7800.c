@@ -0,0 +1,258 @@
+/**
+ * @file emul_hl7800.c
+ * @brief Emulation of the HL7800 driver functions used by the module
+ *
+ * An update reads the file in XMODEM sized blocks, one block per UART transfer time, and reports
+ * FOTA_STATE and FOTA_COUNT events like the driver. Once the file is transferred the modem
+ * installs it, restarts and reports its revision.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <string.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/drivers/modem/hl7800.h>
+
+#include "emul_hl7800.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define FW_VERSION "HL7800.4.6.9.4"
+#define FW_VERSION_MAX_LEN 32
+#define XMODEM_BLOCK_SIZE 1024
+/* Start bit, 8 data bits and stop bit */
+#define UART_BITS_PER_BYTE 10
+
+enum fota_step {
+	FOTA_STEP_TRANSFER = 0,
+	FOTA_STEP_INSTALL,
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static void fota_work_cb(struct k_work *work);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static sys_slist_t agent_list = SYS_SLIST_STATIC_INIT(&agent_list);
+static char fw_version[FW_VERSION_MAX_LEN] = FW_VERSION;
+static char update_version[FW_VERSION_MAX_LEN];
+static uint32_t baud = CONFIG_SW_MGMT_TEST_HL7800_BAUD;
+static emul_hl7800_fault_t next_fault;
+static K_MUTEX_DEFINE(emul_lock);
+
+static atomic_t busy;
+static atomic_t update_count;
+static K_WORK_DELAYABLE_DEFINE(fota_work, fota_work_cb);
+static enum fota_step step;
+static emul_hl7800_fault_t update_fault;
+static struct fs_file_t file;
+static uint8_t block[XMODEM_BLOCK_SIZE];
+static uint8_t fota_state;
+static uint32_t fota_count;
+static uint32_t transfer_crc;
+
+static uint32_t image_crc;
+static size_t image_size;
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void notify(enum mdm_hl7800_event event, void *event_data)
+{
+	struct mdm_hl7800_callback_agent *agent;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&agent_list, agent, node) {
+		agent->event_callback(event, event_data);
+	}
+}
+
+static void notify_state(uint8_t state)
+{
+	fota_state = state;
+	notify(HL7800_EVENT_FOTA_STATE, &fota_state);
+}
+
+static k_timeout_t transfer_time(size_t len)
+{
+	uint32_t rate;
+
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	rate = baud;
+	k_mutex_unlock(&emul_lock);
+
+	return K_USEC(((uint64_t)len * UART_BITS_PER_BYTE * USEC_PER_SEC) / rate);
+}
+
+/* The update is over before the modem reports it, so the next one can start from the event */
+static void fota_end(uint8_t state)
+{
+	(void)atomic_set(&busy, 0);
+	notify_state(state);
+}
+
+static void fota_transfer(void)
+{
+	ssize_t len;
+
+	if (fota_count == 0) {
+		notify_state(HL7800_FOTA_START);
+		notify_state(HL7800_FOTA_WIP);
+	}
+
+	len = fs_read(&file, block, sizeof(block));
+	if (len > 0) {
+		transfer_crc = crc32_ieee_update(transfer_crc, block, len);
+		fota_count += len;
+		notify(HL7800_EVENT_FOTA_COUNT, &fota_count);
+		k_work_reschedule(&fota_work, transfer_time(len));
+		return;
+	}
+
+	(void)fs_close(&file);
+	if (len < 0 || update_fault == EMUL_HL7800_FAULT_FILE) {
+		fota_end(HL7800_FOTA_FILE_ERROR);
+		return;
+	}
+
+	notify_state(HL7800_FOTA_PAD);
+	notify_state(HL7800_FOTA_SEND_EOT);
+	notify_state(HL7800_FOTA_INSTALL);
+	step = FOTA_STEP_INSTALL;
+	k_work_reschedule(&fota_work, K_MSEC(CONFIG_SW_MGMT_TEST_HL7800_INSTALL_MS));
+}
+
+static void fota_install(void)
+{
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	image_crc = transfer_crc;
+	image_size = fota_count;
+	if (update_version[0] != '\0') {
+		strcpy(fw_version, update_version);
+		update_version[0] = '\0';
+	}
+	k_mutex_unlock(&emul_lock);
+	(void)atomic_inc(&update_count);
+
+	notify_state(HL7800_FOTA_REBOOT_AND_RECONFIGURE);
+	notify(HL7800_EVENT_REVISION, fw_version);
+	fota_end(HL7800_FOTA_COMPLETE);
+}
+
+static void fota_work_cb(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (step == FOTA_STEP_TRANSFER) {
+		fota_transfer();
+	} else {
+		fota_install();
+	}
+}
+
+/**************************************************************************************************/
+/* Driver Function Definitions                                                                    */
+/**************************************************************************************************/
+int mdm_hl7800_register_event_callback(struct mdm_hl7800_callback_agent *agent)
+{
+	sys_slist_append(&agent_list, &agent->node);
+	return 0;
+}
+
+char *mdm_hl7800_get_fw_version(void)
+{
+	return fw_version;
+}
+
+int32_t mdm_hl7800_update_fw(char *file_path)
+{
+	int ret;
+
+	if (!atomic_cas(&busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	update_fault = next_fault;
+	next_fault = EMUL_HL7800_FAULT_NONE;
+	k_mutex_unlock(&emul_lock);
+
+	if (update_fault == EMUL_HL7800_FAULT_UPDATE) {
+		ret = -EIO;
+		goto exit;
+	}
+
+	fs_file_t_init(&file);
+	ret = fs_open(&file, file_path, FS_O_READ);
+	if (ret < 0) {
+		goto exit;
+	}
+
+	step = FOTA_STEP_TRANSFER;
+	fota_count = 0;
+	transfer_crc = 0;
+	k_work_reschedule(&fota_work, K_NO_WAIT);
+
+exit:
+	if (ret < 0) {
+		(void)atomic_set(&busy, 0);
+	}
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+void emul_hl7800_inject_fault(emul_hl7800_fault_t fault)
+{
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	next_fault = fault;
+	k_mutex_unlock(&emul_lock);
+}
+
+void emul_hl7800_set_baud(uint32_t rate)
+{
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	baud = (rate == 0) ? CONFIG_SW_MGMT_TEST_HL7800_BAUD : rate;
+	k_mutex_unlock(&emul_lock);
+}
+
+void emul_hl7800_set_update_version(const char *version)
+{
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	strncpy(update_version, version, sizeof(update_version) - 1);
+	k_mutex_unlock(&emul_lock);
+}
+
+bool emul_hl7800_busy(void)
+{
+	return atomic_get(&busy) != 0;
+}
+
+int emul_hl7800_update_count(void)
+{
+	return atomic_get(&update_count);
+}
+
+uint32_t emul_hl7800_image_crc(size_t *size)
+{
+	uint32_t crc;
+
+	k_mutex_lock(&emul_lock, K_FOREVER);
+	crc = image_crc;
+	if (size != NULL) {
+		*size = image_size;
+	}
+	k_mutex_unlock(&emul_lock);
+	return crc;
+}
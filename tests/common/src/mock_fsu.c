@@ -0,0 +1,85 @@
+/**
+ * @file mock_fsu.c
+ * @brief File system utilities used by the module, implemented on the Zephyr file system API so
+ * they see the same files (and failures) as the module's own file system calls
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/fs/fs.h>
+#include <file_system_utilities.h>
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static ssize_t write_file(const char *abs_path, void *data, size_t size, bool append)
+{
+	struct fs_file_t f;
+	ssize_t ret;
+	int close_ret;
+
+	fs_file_t_init(&f);
+	ret = fs_open(&f, abs_path, FS_O_CREATE | FS_O_WRITE | (append ? FS_O_APPEND : 0));
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!append) {
+		ret = fs_truncate(&f, 0);
+	}
+	if (ret == 0) {
+		ret = fs_write(&f, data, size);
+	}
+
+	close_ret = fs_close(&f);
+	return (ret >= 0 && close_ret < 0) ? close_ret : ret;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+ssize_t fsu_get_file_size_abs(const char *abs_path)
+{
+	struct fs_dirent entry;
+	int ret;
+
+	ret = fs_stat(abs_path, &entry);
+	return ret < 0 ? ret : entry.size;
+}
+
+int fsu_delete_abs(const char *abs_path)
+{
+	return fs_unlink(abs_path);
+}
+
+ssize_t fsu_append_abs(const char *abs_path, void *data, size_t size)
+{
+	return write_file(abs_path, data, size, true);
+}
+
+ssize_t fsu_write_abs(const char *abs_path, void *data, size_t size)
+{
+	return write_file(abs_path, data, size, false);
+}
+
+ssize_t fsu_read_abs(const char *abs_path, void *data, size_t size)
+{
+	struct fs_file_t f;
+	ssize_t ret;
+
+	fs_file_t_init(&f);
+	ret = fs_open(&f, abs_path, FS_O_READ);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = fs_read(&f, data, size);
+	(void)fs_close(&f);
+	return ret;
+}
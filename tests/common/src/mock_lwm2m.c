@@ -0,0 +1,299 @@
+/**
+ * @file mock_lwm2m.c
+ * @brief Mock of the LwM2M engine parts used by the module
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <version.h>
+#include <string.h>
+#include <zephyr/net/lwm2m.h>
+#include <lwm2m_engine.h>
+
+#include "mock_lwm2m.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_INSTANCES CONFIG_LWM2M_SWMGMT_MAX_INSTANCES
+#define MAX_RESOURCES 32
+#define MAX_VALUE_SIZE 256
+
+struct mock_res {
+	char path[LWM2M_MAX_PATH_STR_LEN];
+	uint8_t value[MAX_VALUE_SIZE];
+	uint16_t len;
+};
+
+struct mock_obj_inst {
+	bool created;
+	lwm2m_engine_execute_cb_t activate_cb;
+	lwm2m_engine_execute_cb_t deactivate_cb;
+	lwm2m_engine_execute_cb_t install_cb;
+	lwm2m_engine_execute_cb_t delete_cb;
+	lwm2m_engine_get_data_cb_t read_ver_cb;
+	lwm2m_engine_set_data_cb_t write_cb;
+	int completions;
+	int last_result;
+};
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct mock_obj_inst obj_insts[MAX_INSTANCES];
+static struct mock_res resources[MAX_RESOURCES];
+static K_MUTEX_DEFINE(mock_lock);
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static struct mock_obj_inst *get_obj_inst(uint16_t obj_inst_id)
+{
+	return obj_inst_id < MAX_INSTANCES ? &obj_insts[obj_inst_id] : NULL;
+}
+
+/* Returns the resource, a free entry for it when create is set, or NULL */
+static struct mock_res *find_res(const char *path, bool create)
+{
+	struct mock_res *free_res = NULL;
+	int i;
+
+	for (i = 0; i < MAX_RESOURCES; i++) {
+		if (resources[i].path[0] == '\0') {
+			if (free_res == NULL) {
+				free_res = &resources[i];
+			}
+		} else if (strcmp(resources[i].path, path) == 0) {
+			return &resources[i];
+		}
+	}
+
+	if (create && free_res != NULL) {
+		strncpy(free_res->path, path, sizeof(free_res->path) - 1);
+	}
+	return create ? free_res : NULL;
+}
+
+static int set_res(const char *path, const void *value, uint16_t len)
+{
+	struct mock_res *res;
+	int ret = 0;
+
+	if (len > MAX_VALUE_SIZE) {
+		return -ENOMEM;
+	}
+
+	k_mutex_lock(&mock_lock, K_FOREVER);
+	res = find_res(path, true);
+	if (res == NULL) {
+		ret = -ENOMEM;
+	} else {
+		memcpy(res->value, value, len);
+		res->len = len;
+	}
+	k_mutex_unlock(&mock_lock);
+	return ret;
+}
+
+static int get_res(const char *path, void *value, uint16_t len)
+{
+	struct mock_res *res;
+	int ret = 0;
+
+	k_mutex_lock(&mock_lock, K_FOREVER);
+	res = find_res(path, false);
+	if (res == NULL) {
+		ret = -ENOENT;
+	} else {
+		memcpy(value, res->value, MIN(len, res->len));
+	}
+	k_mutex_unlock(&mock_lock);
+	return ret;
+}
+
+/**************************************************************************************************/
+/* Engine Function Definitions                                                                    */
+/**************************************************************************************************/
+int lwm2m_create_obj_inst(uint16_t obj_id, uint16_t obj_inst_id,
+			  struct lwm2m_engine_obj_inst **obj_inst)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst_id);
+
+	if (obj_id != LWM2M_OBJECT_SOFTWARE_MANAGEMENT_ID || inst == NULL) {
+		return -EINVAL;
+	}
+	if (inst->created) {
+		return -EEXIST;
+	}
+
+	memset(inst, 0, sizeof(*inst));
+	inst->created = true;
+	/* The module never dereferences the engine instance */
+	*obj_inst = (struct lwm2m_engine_obj_inst *)inst;
+	return 0;
+}
+
+int lwm2m_delete_obj_inst(uint16_t obj_id, uint16_t obj_inst_id)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst_id);
+
+	if (obj_id != LWM2M_OBJECT_SOFTWARE_MANAGEMENT_ID || inst == NULL || !inst->created) {
+		return -ENOENT;
+	}
+
+	memset(inst, 0, sizeof(*inst));
+	return 0;
+}
+
+int lwm2m_engine_create_res_inst(const char *pathstr)
+{
+	return set_res(pathstr, NULL, 0);
+}
+
+int lwm2m_engine_set_string(const char *pathstr, char *data_ptr)
+{
+	return set_res(pathstr, data_ptr, strlen(data_ptr) + 1);
+}
+
+int lwm2m_engine_get_string(const char *pathstr, void *str, uint16_t strlen)
+{
+	if (strlen > 0) {
+		((char *)str)[0] = '\0';
+	}
+	return get_res(pathstr, str, strlen);
+}
+
+int lwm2m_engine_set_u8(const char *pathstr, uint8_t value)
+{
+	return set_res(pathstr, &value, sizeof(value));
+}
+
+int lwm2m_engine_set_bool(const char *pathstr, bool value)
+{
+	return set_res(pathstr, &value, sizeof(value));
+}
+
+int lwm2m_engine_get_bool(const char *pathstr, bool *value)
+{
+	return get_res(pathstr, value, sizeof(*value));
+}
+
+#if ZEPHYR_VERSION_CODE >= ZEPHYR_VERSION(3, 3, 0)
+void lwm2m_registry_lock(void)
+{
+	k_mutex_lock(&mock_lock, K_FOREVER);
+}
+
+void lwm2m_registry_unlock(void)
+{
+	k_mutex_unlock(&mock_lock);
+}
+#endif
+
+#define SWMGMT_SET_CB(_name, _type, _field)                                                        \
+	int lwm2m_swmgmt_set_##_name(uint16_t obj_inst_id, _type cb)                               \
+	{                                                                                          \
+		struct mock_obj_inst *inst = get_obj_inst(obj_inst_id);                            \
+                                                                                                   \
+		if (inst == NULL || !inst->created) {                                              \
+			return -ENOENT;                                                            \
+		}                                                                                  \
+		inst->_field = cb;                                                                 \
+		return 0;                                                                          \
+	}
+
+SWMGMT_SET_CB(activate_cb, lwm2m_engine_execute_cb_t, activate_cb)
+SWMGMT_SET_CB(deactivate_cb, lwm2m_engine_execute_cb_t, deactivate_cb)
+SWMGMT_SET_CB(install_package_cb, lwm2m_engine_execute_cb_t, install_cb)
+SWMGMT_SET_CB(delete_package_cb, lwm2m_engine_execute_cb_t, delete_cb)
+SWMGMT_SET_CB(read_package_version_cb, lwm2m_engine_get_data_cb_t, read_ver_cb)
+SWMGMT_SET_CB(write_package_cb, lwm2m_engine_set_data_cb_t, write_cb)
+
+int lwm2m_swmgmt_install_completed(uint16_t obj_inst_id, int error_code)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst_id);
+
+	if (inst == NULL || !inst->created) {
+		return -ENOENT;
+	}
+
+	k_mutex_lock(&mock_lock, K_FOREVER);
+	inst->completions++;
+	inst->last_result = error_code;
+	k_mutex_unlock(&mock_lock);
+	return 0;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int mock_lwm2m_write_package(uint16_t obj_inst, uint8_t *data, uint16_t data_len,
+			     bool last_block, size_t total_size)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst);
+
+	if (inst == NULL || inst->write_cb == NULL) {
+		return -ENOENT;
+	}
+
+	/* Package is resource 2 */
+	return inst->write_cb(obj_inst, 2, 0, data, data_len, last_block, total_size);
+}
+
+int mock_lwm2m_execute(uint16_t obj_inst, uint16_t res_id)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst);
+	lwm2m_engine_execute_cb_t cb = NULL;
+
+	if (inst == NULL) {
+		return -ENOENT;
+	}
+
+	switch (res_id) {
+	case MOCK_LWM2M_RES_INSTALL:
+		cb = inst->install_cb;
+		break;
+	case MOCK_LWM2M_RES_UNINSTALL:
+		cb = inst->delete_cb;
+		break;
+	case MOCK_LWM2M_RES_ACTIVATE:
+		cb = inst->activate_cb;
+		break;
+	case MOCK_LWM2M_RES_DEACTIVATE:
+		cb = inst->deactivate_cb;
+		break;
+	default:
+		break;
+	}
+
+	return cb == NULL ? -ENOENT : cb(obj_inst, NULL, 0);
+}
+
+int mock_lwm2m_get_u8(const char *path, uint8_t *value)
+{
+	return get_res(path, value, sizeof(*value));
+}
+
+int mock_lwm2m_install_completions(uint16_t obj_inst, int *last_result)
+{
+	struct mock_obj_inst *inst = get_obj_inst(obj_inst);
+	int count;
+
+	if (inst == NULL) {
+		return 0;
+	}
+
+	k_mutex_lock(&mock_lock, K_FOREVER);
+	count = inst->completions;
+	if (last_result != NULL) {
+		*last_result = inst->last_result;
+	}
+	k_mutex_unlock(&mock_lock);
+	return count;
+}
@@ -0,0 +1,600 @@
+/**
+ * @file ram_fs.c
+ * @brief File system kept in RAM, mounted at CONFIG_FSU_MOUNT_POINT for the tests
+ *
+ * Files live in a flat directory. Each one gets an equal, fixed part of the capacity, so a write
+ * past that part fails with -ENOSPC like a full file system would. Faults are injected per
+ * operation: a number of calls fail with a given error after a number of calls succeed, and each
+ * call can be made to sleep first.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/init.h>
+#include <string.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/fs/fs_sys.h>
+
+#include "ram_fs.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define FS_TYPE_RAM (FS_TYPE_EXTERNAL_BASE + 1)
+#define FILE_COUNT CONFIG_SW_MGMT_TEST_RAM_FS_FILES
+#define FILE_SIZE (CONFIG_SW_MGMT_TEST_RAM_FS_SIZE / FILE_COUNT)
+#define HANDLE_COUNT 8
+#define BLOCK_SIZE 256
+/* MAX_FILE_NAME is only 12 without LittleFS, too short for the staging file names */
+#define NAME_SIZE 64
+
+struct ram_file {
+	bool used;
+	char name[NAME_SIZE];
+	size_t size;
+	uint8_t *data;
+};
+
+struct ram_handle {
+	struct ram_file *file;
+	fs_mode_t flags;
+	off_t pos;
+};
+
+struct ram_fault {
+	/* Calls that succeed before the next count calls fail with error, count < 0 is forever */
+	int skip;
+	int count;
+	int error;
+	uint32_t latency_us;
+	uint32_t calls;
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int ram_open(struct fs_file_t *filp, const char *fs_path, fs_mode_t flags);
+static ssize_t ram_read(struct fs_file_t *filp, void *dest, size_t nbytes);
+static ssize_t ram_write(struct fs_file_t *filp, const void *src, size_t nbytes);
+static int ram_lseek(struct fs_file_t *filp, off_t off, int whence);
+static off_t ram_tell(struct fs_file_t *filp);
+static int ram_truncate(struct fs_file_t *filp, off_t length);
+static int ram_sync(struct fs_file_t *filp);
+static int ram_close(struct fs_file_t *filp);
+static int ram_mount(struct fs_mount_t *mountp);
+static int ram_unlink(struct fs_mount_t *mountp, const char *name);
+static int ram_rename(struct fs_mount_t *mountp, const char *from, const char *to);
+static int ram_stat(struct fs_mount_t *mountp, const char *path, struct fs_dirent *entry);
+static int ram_statvfs(struct fs_mount_t *mountp, const char *path, struct fs_statvfs *stat);
+static int ram_fs_init(const struct device *device);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static uint8_t storage[FILE_COUNT][FILE_SIZE];
+static struct ram_file files[FILE_COUNT];
+static struct ram_handle handles[HANDLE_COUNT];
+static struct ram_fault faults[RAM_FS_OP_COUNT];
+static size_t capacity = CONFIG_SW_MGMT_TEST_RAM_FS_SIZE;
+static K_MUTEX_DEFINE(ram_lock);
+
+static const struct fs_file_system_t ram_fs = {
+	.open = ram_open,
+	.read = ram_read,
+	.write = ram_write,
+	.lseek = ram_lseek,
+	.tell = ram_tell,
+	.truncate = ram_truncate,
+	.sync = ram_sync,
+	.close = ram_close,
+	.mount = ram_mount,
+	.unlink = ram_unlink,
+	.rename = ram_rename,
+	.stat = ram_stat,
+	.statvfs = ram_statvfs,
+};
+
+static struct fs_mount_t ram_mnt = {
+	.type = FS_TYPE_RAM,
+	.mnt_point = CONFIG_FSU_MOUNT_POINT,
+};
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+/* Called first by every operation, returns the error to fail it with or 0 */
+static int fault_check(enum ram_fs_op op)
+{
+	struct ram_fault *fault = &faults[op];
+	uint32_t latency_us;
+	int ret = 0;
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	fault->calls++;
+	latency_us = fault->latency_us;
+	if (fault->skip > 0) {
+		fault->skip--;
+	} else if (fault->count != 0) {
+		if (fault->count > 0) {
+			fault->count--;
+		}
+		ret = fault->error;
+	}
+	k_mutex_unlock(&ram_lock);
+
+	if (latency_us > 0) {
+		k_sleep(K_USEC(latency_us));
+	}
+	return ret;
+}
+
+/* Must be called with ram_lock held */
+static size_t used_bytes(void)
+{
+	size_t used = 0;
+	int i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		if (files[i].used) {
+			used += files[i].size;
+		}
+	}
+	return used;
+}
+
+/* Paths include the mount point */
+static const char *file_name(const char *path)
+{
+	path += ram_mnt.mountp_len;
+	return (*path == '/') ? path + 1 : path;
+}
+
+static struct ram_file *file_lookup(const char *path)
+{
+	const char *name = file_name(path);
+	int i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		if (files[i].used && strcmp(files[i].name, name) == 0) {
+			return &files[i];
+		}
+	}
+	return NULL;
+}
+
+static struct ram_file *file_create(const char *path)
+{
+	const char *name = file_name(path);
+	int i;
+
+	if (strlen(name) == 0 || strlen(name) >= NAME_SIZE) {
+		return NULL;
+	}
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		if (!files[i].used) {
+			files[i].used = true;
+			strcpy(files[i].name, name);
+			files[i].size = 0;
+			files[i].data = storage[i];
+			return &files[i];
+		}
+	}
+	return NULL;
+}
+
+static bool file_is_open(struct ram_file *file)
+{
+	int i;
+
+	for (i = 0; i < HANDLE_COUNT; i++) {
+		if (handles[i].file == file) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int ram_open(struct fs_file_t *filp, const char *fs_path, fs_mode_t flags)
+{
+	struct ram_handle *handle = NULL;
+	struct ram_file *file;
+	int ret;
+	int i;
+
+	ret = fault_check(RAM_FS_OP_OPEN);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	for (i = 0; i < HANDLE_COUNT; i++) {
+		if (handles[i].file == NULL) {
+			handle = &handles[i];
+			break;
+		}
+	}
+	if (handle == NULL) {
+		ret = -ENFILE;
+		goto exit;
+	}
+
+	file = file_lookup(fs_path);
+	if (file == NULL && (flags & FS_O_CREATE) != 0) {
+		file = file_create(fs_path);
+		if (file == NULL) {
+			ret = -ENOSPC;
+			goto exit;
+		}
+	}
+	if (file == NULL) {
+		ret = -ENOENT;
+		goto exit;
+	}
+
+	handle->file = file;
+	handle->flags = flags;
+	handle->pos = 0;
+	filp->filep = handle;
+
+exit:
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static ssize_t ram_read(struct fs_file_t *filp, void *dest, size_t nbytes)
+{
+	struct ram_handle *handle = filp->filep;
+	size_t len;
+	int ret;
+
+	ret = fault_check(RAM_FS_OP_READ);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	len = (handle->pos < handle->file->size) ? (handle->file->size - handle->pos) : 0;
+	len = MIN(len, nbytes);
+	memcpy(dest, &handle->file->data[handle->pos], len);
+	handle->pos += len;
+	k_mutex_unlock(&ram_lock);
+	return len;
+}
+
+static ssize_t ram_write(struct fs_file_t *filp, const void *src, size_t nbytes)
+{
+	struct ram_handle *handle = filp->filep;
+	struct ram_file *file = handle->file;
+	size_t end;
+	ssize_t ret;
+
+	ret = fault_check(RAM_FS_OP_WRITE);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	if ((handle->flags & FS_O_APPEND) != 0) {
+		handle->pos = file->size;
+	}
+	end = handle->pos + nbytes;
+	if (end > FILE_SIZE || (end > file->size && used_bytes() + end - file->size > capacity)) {
+		ret = -ENOSPC;
+		goto exit;
+	}
+
+	/* A gap left by seeking past the end reads as zeros */
+	if (handle->pos > file->size) {
+		memset(&file->data[file->size], 0, handle->pos - file->size);
+	}
+	memcpy(&file->data[handle->pos], src, nbytes);
+	handle->pos += nbytes;
+	file->size = MAX(file->size, handle->pos);
+	ret = nbytes;
+
+exit:
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static int ram_lseek(struct fs_file_t *filp, off_t off, int whence)
+{
+	struct ram_handle *handle = filp->filep;
+	off_t pos;
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	switch (whence) {
+	case FS_SEEK_SET:
+		pos = off;
+		break;
+	case FS_SEEK_CUR:
+		pos = handle->pos + off;
+		break;
+	case FS_SEEK_END:
+		pos = handle->file->size + off;
+		break;
+	default:
+		pos = -1;
+		break;
+	}
+	if (pos >= 0 && pos <= FILE_SIZE) {
+		handle->pos = pos;
+	}
+	k_mutex_unlock(&ram_lock);
+	return (pos >= 0 && pos <= FILE_SIZE) ? 0 : -EINVAL;
+}
+
+static off_t ram_tell(struct fs_file_t *filp)
+{
+	return ((struct ram_handle *)filp->filep)->pos;
+}
+
+static int ram_truncate(struct fs_file_t *filp, off_t length)
+{
+	struct ram_file *file = ((struct ram_handle *)filp->filep)->file;
+	int ret;
+
+	if (length < 0 || length > FILE_SIZE) {
+		return -EINVAL;
+	}
+
+	ret = fault_check(RAM_FS_OP_TRUNCATE);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	if (length > file->size) {
+		memset(&file->data[file->size], 0, length - file->size);
+	}
+	file->size = length;
+	k_mutex_unlock(&ram_lock);
+	return 0;
+}
+
+static int ram_sync(struct fs_file_t *filp)
+{
+	ARG_UNUSED(filp);
+
+	return 0;
+}
+
+static int ram_close(struct fs_file_t *filp)
+{
+	struct ram_handle *handle = filp->filep;
+	int ret;
+
+	ret = fault_check(RAM_FS_OP_CLOSE);
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	handle->file = NULL;
+	filp->filep = NULL;
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static int ram_mount(struct fs_mount_t *mountp)
+{
+	ARG_UNUSED(mountp);
+
+	return 0;
+}
+
+static int ram_unlink(struct fs_mount_t *mountp, const char *name)
+{
+	struct ram_file *file;
+	int ret;
+
+	ARG_UNUSED(mountp);
+
+	ret = fault_check(RAM_FS_OP_UNLINK);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	file = file_lookup(name);
+	if (file == NULL) {
+		ret = -ENOENT;
+	} else if (file_is_open(file)) {
+		ret = -EBUSY;
+	} else {
+		file->used = false;
+	}
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static int ram_rename(struct fs_mount_t *mountp, const char *from, const char *to)
+{
+	struct ram_file *file;
+	struct ram_file *replaced;
+	int ret;
+
+	ARG_UNUSED(mountp);
+
+	if (strlen(file_name(to)) >= NAME_SIZE) {
+		return -ENAMETOOLONG;
+	}
+
+	ret = fault_check(RAM_FS_OP_RENAME);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	file = file_lookup(from);
+	replaced = file_lookup(to);
+	if (file == NULL) {
+		ret = -ENOENT;
+		goto exit;
+	}
+	if (replaced != NULL && replaced != file) {
+		replaced->used = false;
+	}
+	strcpy(file->name, file_name(to));
+
+exit:
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static int ram_stat(struct fs_mount_t *mountp, const char *path, struct fs_dirent *entry)
+{
+	struct ram_file *file;
+	int ret;
+
+	ARG_UNUSED(mountp);
+
+	ret = fault_check(RAM_FS_OP_STAT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	file = file_lookup(path);
+	if (file == NULL) {
+		ret = -ENOENT;
+	} else {
+		entry->type = FS_DIR_ENTRY_FILE;
+		strncpy(entry->name, file->name, sizeof(entry->name) - 1);
+		entry->name[sizeof(entry->name) - 1] = '\0';
+		entry->size = file->size;
+	}
+	k_mutex_unlock(&ram_lock);
+	return ret;
+}
+
+static int ram_statvfs(struct fs_mount_t *mountp, const char *path, struct fs_statvfs *stat)
+{
+	size_t used = 0;
+	int ret;
+	int i;
+
+	ARG_UNUSED(mountp);
+	ARG_UNUSED(path);
+
+	ret = fault_check(RAM_FS_OP_STATVFS);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	for (i = 0; i < FILE_COUNT; i++) {
+		if (files[i].used) {
+			used += ROUND_UP(files[i].size, BLOCK_SIZE);
+		}
+	}
+	stat->f_bsize = BLOCK_SIZE;
+	stat->f_frsize = BLOCK_SIZE;
+	stat->f_blocks = capacity / BLOCK_SIZE;
+	stat->f_bfree = stat->f_blocks - MIN(used / BLOCK_SIZE, stat->f_blocks);
+	k_mutex_unlock(&ram_lock);
+	return 0;
+}
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+void ram_fs_format(void)
+{
+	int i;
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	for (i = 0; i < FILE_COUNT; i++) {
+		files[i].used = false;
+	}
+	k_mutex_unlock(&ram_lock);
+}
+
+void ram_fs_inject_error(enum ram_fs_op op, int skip, int count, int error)
+{
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	faults[op].skip = skip;
+	faults[op].count = count;
+	faults[op].error = error;
+	k_mutex_unlock(&ram_lock);
+}
+
+void ram_fs_set_latency(enum ram_fs_op op, uint32_t latency_us)
+{
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	faults[op].latency_us = latency_us;
+	k_mutex_unlock(&ram_lock);
+}
+
+void ram_fs_set_capacity(size_t bytes)
+{
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	capacity = (bytes == 0) ? CONFIG_SW_MGMT_TEST_RAM_FS_SIZE : bytes;
+	k_mutex_unlock(&ram_lock);
+}
+
+void ram_fs_reset_faults(void)
+{
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	memset(faults, 0, sizeof(faults));
+	capacity = CONFIG_SW_MGMT_TEST_RAM_FS_SIZE;
+	k_mutex_unlock(&ram_lock);
+}
+
+uint32_t ram_fs_calls(enum ram_fs_op op)
+{
+	return faults[op].calls;
+}
+
+int ram_fs_open_files(void)
+{
+	int count = 0;
+	int i;
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	for (i = 0; i < HANDLE_COUNT; i++) {
+		if (handles[i].file != NULL) {
+			count++;
+		}
+	}
+	k_mutex_unlock(&ram_lock);
+	return count;
+}
+
+int ram_fs_file_count(void)
+{
+	int count = 0;
+	int i;
+
+	k_mutex_lock(&ram_lock, K_FOREVER);
+	for (i = 0; i < FILE_COUNT; i++) {
+		if (files[i].used) {
+			count++;
+		}
+	}
+	k_mutex_unlock(&ram_lock);
+	return count;
+}
+
+/**************************************************************************************************/
+/* SYS INIT                                                                                       */
+/**************************************************************************************************/
+/* Mounted before the backends open their staging files */
+SYS_INIT(ram_fs_init, APPLICATION, 0);
+
+static int ram_fs_init(const struct device *device)
+{
+	int ret;
+
+	ARG_UNUSED(device);
+
+	ret = fs_register(FS_TYPE_RAM, &ram_fs);
+	if (ret == 0) {
+		ret = fs_mount(&ram_mnt);
+	}
+	return ret;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file test_clock.c
+ * @brief Clock for timing code in the tests
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+
+#include "test_clock.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#if defined(CONFIG_ARCH_POSIX)
+/* The executable links against the host C library, where timespec is two longs */
+struct host_timespec {
+	long tv_sec;
+	long tv_nsec;
+};
+
+#define HOST_CLOCK_MONOTONIC 1
+
+extern int host_clock_gettime(int clock_id, struct host_timespec *tp) __asm__("clock_gettime");
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+uint64_t test_clock_ns(void)
+{
+#if defined(CONFIG_ARCH_POSIX)
+	struct host_timespec ts;
+
+	(void)host_clock_gettime(HOST_CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+#else
+	/* Extends the 32 bit counter, so the clock must be read at least once per wrap */
+	static uint32_t last;
+	static uint64_t cycles;
+	uint64_t total;
+	unsigned int key = irq_lock();
+	uint32_t now = k_cycle_get_32();
+
+	cycles += (uint32_t)(now - last);
+	last = now;
+	total = cycles;
+	irq_unlock(key);
+	return k_cyc_to_ns_floor64(total);
+#endif
+}
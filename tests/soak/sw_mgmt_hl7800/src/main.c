@@ -0,0 +1,608 @@
+/**
+ * @file main.c
+ * @brief Soak test of the HL7800 backend: download and install cycles against the emulated modem
+ * and the RAM file system, with write errors, full file systems, restarts (of the same or of
+ * another package), duplicate blocks and modem faults
+ *
+ * Every cycle ends with an install that must succeed and leave the modem with the package. The
+ * summary is printed as one JSON object, prefixed with "SOAK ", so it can be collected from the
+ * twister handler log.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/zephyr.h>
+#include <zephyr/ztest.h>
+#include <string.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/drivers/modem/hl7800.h>
+#include <file_system_utilities.h>
+
+#include "lcz_lwm2m_sw_mgmt.h"
+#include "mock_lwm2m.h"
+#include "ram_fs.h"
+#include "emul_hl7800.h"
+#include "test_clock.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define OBJ_INST CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_OBJ_INST
+#define FILE_PATH CONFIG_FSU_MOUNT_POINT "/" CONFIG_LCZ_LWM2M_SW_MGMT_HL7800_FILE_NAME
+
+#define MAX_PACKAGE_SIZE (48 * 1024)
+#define PACKAGE_SIZE (20 * 1024 + 123)
+#define BLOCK_SIZE 512
+/* LwM2M block sizes are 16 << 0 to 16 << 6 */
+#define MIN_BLOCK_SIZE 16
+#define BLOCK_SIZE_STEPS 7
+/* Blocks the emulated modem reads from the update file */
+#define MODEM_READ_SIZE 1024
+
+#define INSTALL_TIMEOUT_MS (60 * MSEC_PER_SEC)
+#define INSTALL_POLL K_MSEC(10)
+
+#define WRITE_LATENCY_US 2000
+#define SLOW_BAUD 115200
+#define FAST_BAUD 921600
+
+enum scenario {
+	SCENARIO_CLEAN = 0,
+	/* The download starts again from the first block part way through */
+	SCENARIO_RESTART,
+	/* A download is dropped part way through for a different package */
+	SCENARIO_NEW_PACKAGE,
+	/* Blocks already received are sent again */
+	SCENARIO_DUPLICATE,
+	/* A file system write fails, the download is started again */
+	SCENARIO_WRITE_ERROR,
+	/* The file system fills up during the download, the download is started again */
+	SCENARIO_NO_SPACE,
+	/* The modem can't start the update, the install is retried */
+	SCENARIO_UPDATE_FAULT,
+	/* The modem rejects the file, the install is retried */
+	SCENARIO_FILE_FAULT,
+	/* The update file can't be read during the transfer, the install is retried */
+	SCENARIO_READ_ERROR,
+	SCENARIO_COUNT
+};
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static uint8_t package[MAX_PACKAGE_SIZE];
+static uint32_t rand_state = CONFIG_SW_MGMT_SOAK_SEED;
+
+/* Host time spent and bytes passed in write_blocks() */
+static uint64_t download_ns;
+static uint64_t download_bytes;
+
+/* Cycle of the soak test that is running, reported if it doesn't finish */
+static int soak_cycle = -1;
+static enum scenario soak_scenario;
+static size_t soak_size;
+static size_t soak_block_size;
+
+static const char *const scenario_names[SCENARIO_COUNT] = {
+	"clean",	"restart",	"new_package",	"duplicate", "write_error",
+	"no_space",	"update_fault", "file_fault",	"read_error",
+};
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+/* xorshift32, so a seed always gives the same cycles */
+static uint32_t rand_next(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static uint32_t rand_below(uint32_t limit)
+{
+	return limit == 0 ? 0 : rand_next() % limit;
+}
+
+static void fill_package(size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		package[i] = (uint8_t)rand_next();
+	}
+}
+
+/* Writes the blocks from offset from (a multiple of block_size) up to offset to, returns the
+ * first error
+ */
+static int write_blocks(size_t from, size_t to, size_t size, size_t block_size)
+{
+	uint64_t start;
+	size_t offset;
+	size_t len;
+	int ret = 0;
+
+	start = test_clock_ns();
+	for (offset = from; offset < to && ret == 0; offset += len) {
+		len = MIN(block_size, size - offset);
+		ret = lcz_lwm2m_sw_mgmt_write_package(OBJ_INST, offset, &package[offset], len,
+						      offset + len == size, size);
+		download_bytes += len;
+	}
+	download_ns += test_clock_ns() - start;
+	return ret;
+}
+
+static void download(size_t size, size_t block_size)
+{
+	int ret;
+
+	ret = write_blocks(0, size, size, block_size);
+	zassert_equal(ret, 0, "Download of %u bytes in %u byte blocks [%d]", (uint32_t)size,
+		      (uint32_t)block_size, ret);
+}
+
+/* Waits for the module to report the result of the install executed with result ret */
+static int install_wait(int completions, int ret)
+{
+	int result = 0;
+	int64_t start;
+
+	start = k_uptime_get();
+	while (mock_lwm2m_install_completions(OBJ_INST, &result) == completions) {
+		if (ret < 0 || k_uptime_get() - start > INSTALL_TIMEOUT_MS) {
+			return ret < 0 ? ret : -ETIMEDOUT;
+		}
+		k_sleep(INSTALL_POLL);
+	}
+	return result;
+}
+
+static int install(void)
+{
+	int completions;
+
+	completions = mock_lwm2m_install_completions(OBJ_INST, NULL);
+	return install_wait(completions, mock_lwm2m_execute(OBJ_INST, MOCK_LWM2M_RES_INSTALL));
+}
+
+static void check_installed(size_t size, int updates)
+{
+	size_t image_size;
+	uint32_t crc;
+
+	crc = emul_hl7800_image_crc(&image_size);
+	zassert_equal(emul_hl7800_update_count(), updates, "Modem updates");
+	zassert_equal(image_size, size, "Installed %u of %u bytes", (uint32_t)image_size,
+		      (uint32_t)size);
+	zassert_equal(crc, crc32_ieee(package, size), "Installed image differs");
+}
+
+/* Files the test expects, the update file is deleted once it is installed */
+static void check_no_leaks(int max_files)
+{
+	zassert_equal(ram_fs_open_files(), 0, "%d files left open", ram_fs_open_files());
+	zassert_true(ram_fs_file_count() <= max_files, "%d files left", ram_fs_file_count());
+	zassert_false(emul_hl7800_busy(), "Modem update left running");
+}
+
+static void install_ok(size_t size)
+{
+	int updates = emul_hl7800_update_count();
+	int ret;
+
+	ret = install();
+	zassert_equal(ret, 0, "Install [%d]", ret);
+	check_installed(size, updates + 1);
+	check_no_leaks(0);
+}
+
+static void install_fails(int expected)
+{
+	int ret;
+
+	ret = install();
+	zassert_equal(ret, expected, "Install result %d, expected %d", ret, expected);
+	/* The downloaded file is kept for another install */
+	check_no_leaks(1);
+	zassert_true(fsu_get_file_size_abs(FILE_PATH) > 0, "Update file deleted");
+}
+
+/* Downloads part of another package of size other_size, then fills the package buffer with
+ * the package of size size
+ */
+static void interrupt_with_other(size_t other_size, size_t part, size_t size, size_t block_size)
+{
+	fill_package(other_size);
+	zassert_ok(write_blocks(0, part, other_size, block_size), "Other package");
+	fill_package(size);
+}
+
+/* Runs a scenario on a package that is already in the package buffer. The download part that
+ * fails is started again and every scenario ends with an installed package.
+ */
+static void run_scenario(enum scenario scenario, size_t size, size_t block_size)
+{
+	size_t blocks = DIV_ROUND_UP(size, block_size);
+	size_t part = rand_below(blocks) * block_size;
+	size_t other_size;
+	size_t offset;
+	size_t dup;
+	size_t len;
+	int ret;
+
+	switch (scenario) {
+	case SCENARIO_RESTART:
+		zassert_ok(write_blocks(0, part, size, block_size), "First part");
+		download(size, block_size);
+		break;
+
+	case SCENARIO_NEW_PACKAGE:
+		/* Staged data of the other package must not end up in the image */
+		other_size = 1 + rand_below(MAX_PACKAGE_SIZE);
+		interrupt_with_other(
+			other_size,
+			MIN((1 + rand_below(DIV_ROUND_UP(other_size, block_size))) * block_size,
+			    other_size),
+			size, block_size);
+		download(size, block_size);
+		break;
+
+	case SCENARIO_DUPLICATE:
+		/* Every block is followed by a block that overlaps what was received */
+		for (offset = 0; offset < size; offset += len) {
+			len = MIN(block_size, size - offset);
+			zassert_ok(write_blocks(offset, offset + len, size, block_size),
+				   "Block at %u", (uint32_t)offset);
+			if (offset > 0 && offset + len < size) {
+				dup = 1 + rand_below(offset + len - 1);
+				ret = lcz_lwm2m_sw_mgmt_write_package(
+					OBJ_INST, dup, &package[dup],
+					MIN(block_size, offset + len - dup), false, size);
+				zassert_ok(ret, "Duplicate at %u [%d]", (uint32_t)dup, ret);
+			}
+		}
+		break;
+
+	case SCENARIO_WRITE_ERROR:
+	case SCENARIO_NO_SPACE:
+		zassert_ok(write_blocks(0, part, size, block_size), "First part");
+		if (scenario == SCENARIO_WRITE_ERROR) {
+			ram_fs_inject_error(RAM_FS_OP_WRITE, 0, -1, -EIO);
+		} else {
+			/* Nothing more fits, the last block at least is still to be written */
+			ram_fs_set_capacity(MAX(fsu_get_file_size_abs(FILE_PATH), 1));
+		}
+		ret = write_blocks(part, size, size, block_size);
+		zassert_equal(ret, scenario == SCENARIO_WRITE_ERROR ? -EIO : -ENOSPC,
+			      "Failed download [%d]", ret);
+		ram_fs_reset_faults();
+		check_no_leaks(1);
+		download(size, block_size);
+		break;
+
+	case SCENARIO_UPDATE_FAULT:
+	case SCENARIO_FILE_FAULT:
+	case SCENARIO_READ_ERROR:
+		download(size, block_size);
+		if (scenario == SCENARIO_READ_ERROR) {
+			/* The read that fails is one of the reads of the transfer */
+			ram_fs_inject_error(RAM_FS_OP_READ,
+					    rand_below(DIV_ROUND_UP(size, MODEM_READ_SIZE) + 1), 1,
+					    -EIO);
+		} else {
+			emul_hl7800_inject_fault(scenario == SCENARIO_UPDATE_FAULT ?
+							 EMUL_HL7800_FAULT_UPDATE :
+							 EMUL_HL7800_FAULT_FILE);
+		}
+		install_fails(-EIO);
+		ram_fs_reset_faults();
+		break;
+
+	default:
+		download(size, block_size);
+		break;
+	}
+
+	install_ok(size);
+}
+
+static void wait_idle(void)
+{
+	int64_t start = k_uptime_get();
+
+	while (emul_hl7800_busy() && k_uptime_get() - start < INSTALL_TIMEOUT_MS) {
+		k_sleep(INSTALL_POLL);
+	}
+}
+
+static void *sw_mgmt_soak_setup(void)
+{
+	/* The same package contents for every run of the fixed scenarios */
+	fill_package(MAX_PACKAGE_SIZE);
+	return NULL;
+}
+
+static void sw_mgmt_soak_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	ram_fs_reset_faults();
+	emul_hl7800_inject_fault(EMUL_HL7800_FAULT_NONE);
+	emul_hl7800_set_baud(0);
+	(void)lcz_lwm2m_sw_mgmt_reset_stats(OBJ_INST);
+}
+
+static void sw_mgmt_soak_after(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	if (soak_cycle >= 0) {
+		printk("Soak stopped at cycle %d: %s, %u bytes in %u byte blocks\n", soak_cycle,
+		       scenario_names[soak_scenario], (uint32_t)soak_size,
+		       (uint32_t)soak_block_size);
+		soak_cycle = -1;
+	}
+
+	wait_idle();
+	ram_fs_reset_faults();
+	emul_hl7800_inject_fault(EMUL_HL7800_FAULT_NONE);
+	emul_hl7800_set_baud(0);
+}
+
+/**************************************************************************************************/
+/* Tests                                                                                          */
+/**************************************************************************************************/
+ZTEST(sw_mgmt_soak, test_clean_install)
+{
+	struct lcz_lwm2m_sw_mgmt_stats stats;
+	size_t offset;
+	size_t len;
+	int ret;
+
+	/* Through the engine write callback, as a server push */
+	for (offset = 0; offset < PACKAGE_SIZE; offset += len) {
+		len = MIN(BLOCK_SIZE, PACKAGE_SIZE - offset);
+		ret = mock_lwm2m_write_package(OBJ_INST, &package[offset], len,
+					       offset + len == PACKAGE_SIZE, PACKAGE_SIZE);
+		zassert_ok(ret, "Block at %u [%d]", (uint32_t)offset, ret);
+	}
+	zassert_equal(fsu_get_file_size_abs(FILE_PATH), PACKAGE_SIZE, "Staged file size");
+
+	emul_hl7800_set_update_version("HL7800.4.7.1.0");
+	install_ok(PACKAGE_SIZE);
+	zassert_equal(strcmp(mdm_hl7800_get_fw_version(), "HL7800.4.7.1.0"), 0,
+		      "Modem version %s", mdm_hl7800_get_fw_version());
+
+	zassert_ok(lcz_lwm2m_sw_mgmt_get_stats(OBJ_INST, &stats), "Stats");
+	zassert_equal(stats.installs, 1, "Installs");
+	zassert_equal(stats.install_bytes, PACKAGE_SIZE, "Install bytes");
+}
+
+ZTEST(sw_mgmt_soak, test_write_error)
+{
+	run_scenario(SCENARIO_WRITE_ERROR, PACKAGE_SIZE, BLOCK_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_write_error_first_block)
+{
+	int ret;
+
+	ram_fs_inject_error(RAM_FS_OP_WRITE, 0, 1, -EIO);
+	ret = write_blocks(0, PACKAGE_SIZE, PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_equal(ret, -EIO, "Failed download [%d]", ret);
+
+	/* Nothing usable was downloaded, so the modem isn't asked to update */
+	ret = install();
+	zassert_true(ret < 0, "Install of a failed download [%d]", ret);
+	zassert_equal(ram_fs_calls(RAM_FS_OP_READ), 0, "Update file read");
+	check_no_leaks(1);
+
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	install_ok(PACKAGE_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_no_space)
+{
+	int ret;
+
+	/* Rejected before anything is written */
+	ram_fs_set_capacity(PACKAGE_SIZE / 2);
+	ret = write_blocks(0, PACKAGE_SIZE, PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_equal(ret, -ENOSPC, "Download larger than the file system [%d]", ret);
+	zassert_equal(ram_fs_calls(RAM_FS_OP_WRITE), 0, "File system written");
+	ram_fs_reset_faults();
+
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	install_ok(PACKAGE_SIZE);
+
+	/* Full part way through */
+	run_scenario(SCENARIO_NO_SPACE, PACKAGE_SIZE, BLOCK_SIZE);
+
+	/* Write reports a full file system */
+	ram_fs_inject_error(RAM_FS_OP_WRITE, 1, -1, -ENOSPC);
+	ret = write_blocks(0, PACKAGE_SIZE, PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_equal(ret, -ENOSPC, "Failed download [%d]", ret);
+	ram_fs_reset_faults();
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	install_ok(PACKAGE_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_duplicate_blocks)
+{
+	run_scenario(SCENARIO_DUPLICATE, PACKAGE_SIZE, BLOCK_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_restart)
+{
+	int ret;
+
+	/* Restarts after the first block, part way and before the last block */
+	ret = write_blocks(0, BLOCK_SIZE, PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_ok(ret, "First block [%d]", ret);
+	ret = write_blocks(0, PACKAGE_SIZE / 2, PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_ok(ret, "First half [%d]", ret);
+	ret = write_blocks(0, ROUND_DOWN(PACKAGE_SIZE - 1, BLOCK_SIZE), PACKAGE_SIZE, BLOCK_SIZE);
+	zassert_ok(ret, "All but the last block [%d]", ret);
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+
+	zassert_equal(fsu_get_file_size_abs(FILE_PATH), PACKAGE_SIZE, "Staged file size");
+	install_ok(PACKAGE_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_new_package)
+{
+	/* Same size, so the staged part of the first package isn't detected as an overrun */
+	interrupt_with_other(PACKAGE_SIZE, PACKAGE_SIZE / 2, PACKAGE_SIZE, BLOCK_SIZE);
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	install_ok(PACKAGE_SIZE);
+
+	/* Larger */
+	interrupt_with_other(PACKAGE_SIZE, PACKAGE_SIZE / 2, MAX_PACKAGE_SIZE, BLOCK_SIZE);
+	download(MAX_PACKAGE_SIZE, BLOCK_SIZE);
+	install_ok(MAX_PACKAGE_SIZE);
+}
+
+ZTEST(sw_mgmt_soak, test_modem_faults)
+{
+	int completions;
+	int updates;
+	int ret;
+
+	run_scenario(SCENARIO_UPDATE_FAULT, PACKAGE_SIZE, BLOCK_SIZE);
+	run_scenario(SCENARIO_FILE_FAULT, PACKAGE_SIZE, BLOCK_SIZE);
+
+	/* An update while the modem is busy with one is refused */
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	updates = emul_hl7800_update_count();
+	completions = mock_lwm2m_install_completions(OBJ_INST, NULL);
+	ret = mock_lwm2m_execute(OBJ_INST, MOCK_LWM2M_RES_INSTALL);
+	k_sleep(K_MSEC(1));
+	zassert_true(emul_hl7800_busy(), "Modem not updating");
+	zassert_equal(mdm_hl7800_update_fw(FILE_PATH), -EBUSY, "Second update");
+
+	ret = install_wait(completions, ret);
+	zassert_ok(ret, "Install [%d]", ret);
+	check_installed(PACKAGE_SIZE, updates + 1);
+	check_no_leaks(0);
+}
+
+ZTEST(sw_mgmt_soak, test_read_error)
+{
+	struct lcz_lwm2m_sw_mgmt_stats stats;
+
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	/* Fails the transfer after two blocks reached the modem */
+	ram_fs_inject_error(RAM_FS_OP_READ, 2, 1, -EIO);
+	install_fails(-EIO);
+	ram_fs_reset_faults();
+	install_ok(PACKAGE_SIZE);
+
+	zassert_ok(lcz_lwm2m_sw_mgmt_get_stats(OBJ_INST, &stats), "Stats");
+	zassert_equal(stats.installs, 1, "Installs");
+	zassert_equal(stats.failures[LCZ_LWM2M_SW_MGMT_FAILURE_INSTALL], 1, "Failed installs");
+}
+
+ZTEST(sw_mgmt_soak, test_latency)
+{
+	int64_t start;
+	int64_t elapsed;
+	uint32_t writes;
+
+	ram_fs_set_latency(RAM_FS_OP_WRITE, WRITE_LATENCY_US);
+	ram_fs_set_latency(RAM_FS_OP_OPEN, WRITE_LATENCY_US / 4);
+
+	start = k_uptime_get();
+	download(PACKAGE_SIZE, BLOCK_SIZE);
+	elapsed = k_uptime_get() - start;
+	writes = ram_fs_calls(RAM_FS_OP_WRITE);
+
+	zassert_true(writes > 0, "No file system writes");
+	zassert_true(elapsed * USEC_PER_MSEC >= (int64_t)writes * WRITE_LATENCY_US,
+		     "%u writes took %u ms", writes, (uint32_t)elapsed);
+	install_ok(PACKAGE_SIZE);
+
+	printk("SOAK {\"test\":\"latency\",\"write_latency_us\":%u,\"writes\":%u,"
+	       "\"download_ms\":%u}\n",
+	       WRITE_LATENCY_US, writes, (uint32_t)elapsed);
+}
+
+ZTEST(sw_mgmt_soak, test_baud_rate)
+{
+	static const uint32_t rates[] = { SLOW_BAUD, FAST_BAUD };
+	int64_t start;
+	uint32_t elapsed;
+	uint32_t transfer_ms;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(rates); i++) {
+		emul_hl7800_set_baud(rates[i]);
+		download(PACKAGE_SIZE, BLOCK_SIZE);
+
+		start = k_uptime_get();
+		install_ok(PACKAGE_SIZE);
+		elapsed = (uint32_t)(k_uptime_get() - start);
+
+		/* Start, data and stop bit of every byte */
+		transfer_ms = (uint32_t)(((uint64_t)PACKAGE_SIZE * 10 * MSEC_PER_SEC) / rates[i]);
+		zassert_true(elapsed >= transfer_ms, "Transfer at %u baud took %u ms", rates[i],
+			     elapsed);
+
+		printk("SOAK {\"test\":\"baud_rate\",\"baud\":%u,\"bytes\":%u,\"install_ms\":%u}\n",
+		       rates[i], PACKAGE_SIZE, elapsed);
+	}
+}
+
+ZTEST(sw_mgmt_soak, test_soak)
+{
+	struct lcz_lwm2m_sw_mgmt_stats stats;
+	uint32_t runs[SCENARIO_COUNT] = { 0 };
+	int updates;
+	int64_t start;
+	int i;
+
+	updates = emul_hl7800_update_count();
+	download_ns = 0;
+	download_bytes = 0;
+	start = k_uptime_get();
+
+	for (soak_cycle = 0; soak_cycle < CONFIG_SW_MGMT_SOAK_CYCLES; soak_cycle++) {
+		soak_scenario = rand_below(SCENARIO_COUNT);
+		soak_size = 1 + rand_below(MAX_PACKAGE_SIZE);
+		soak_block_size = MIN_BLOCK_SIZE << rand_below(BLOCK_SIZE_STEPS);
+		fill_package(soak_size);
+
+		run_scenario(soak_scenario, soak_size, soak_block_size);
+		runs[soak_scenario]++;
+	}
+	soak_cycle = -1;
+
+	zassert_equal(emul_hl7800_update_count() - updates, CONFIG_SW_MGMT_SOAK_CYCLES,
+		      "Modem updates");
+	zassert_ok(lcz_lwm2m_sw_mgmt_get_stats(OBJ_INST, &stats), "Stats");
+	zassert_equal(stats.installs, CONFIG_SW_MGMT_SOAK_CYCLES, "Installs");
+	zassert_equal(stats.failures[LCZ_LWM2M_SW_MGMT_FAILURE_INSTALL],
+		      runs[SCENARIO_UPDATE_FAULT] + runs[SCENARIO_FILE_FAULT] +
+			      runs[SCENARIO_READ_ERROR],
+		      "Failed installs");
+
+	printk("SOAK {\"test\":\"soak\",\"cycles\":%d,\"seed\":%d,\"bytes\":%u,"
+	       "\"download_bytes_per_s\":%u,\"simulated_s\":%u",
+	       CONFIG_SW_MGMT_SOAK_CYCLES, CONFIG_SW_MGMT_SOAK_SEED, (uint32_t)download_bytes,
+	       (uint32_t)((download_bytes * NSEC_PER_SEC) / MAX(download_ns, 1)),
+	       (uint32_t)((k_uptime_get() - start) / MSEC_PER_SEC));
+	for (i = 0; i < SCENARIO_COUNT; i++) {
+		printk(",\"%s\":%u", scenario_names[i], runs[i]);
+	}
+	printk("}\n");
+}
+
+ZTEST_SUITE(sw_mgmt_soak, NULL, sw_mgmt_soak_setup, sw_mgmt_soak_before, sw_mgmt_soak_after,
+	    NULL);